@@ -1,6 +1,20 @@
-gcc -shared cobs.c -o libcobs.a
+gcc -shared cobs.c cobs_parallel.c cobs_frame_pool.c cobs_zpe.c cobs_crc.c cobs_queue.c cobs_view.c -lpthread -o libcobs.a
+gcc -shared cobs_server.c -L. -lcobs -o libcobs_server.a
+gcc -shared -fPIC -DCOBS_ENABLE_STATS cobs.c cobs_parallel.c cobs_frame_pool.c cobs_zpe.c cobs_crc.c cobs_queue.c cobs_view.c -lpthread -o libcobs_stats.a
 gcc -shared cobs_jf.c -o libjfcobs.a
 gcc -shared cobs_scmb.c -o libscmbcobs.a
-gcc -L. -lcobs cobs_test.c -o cobs_test.exe
-gcc -L. -ljfcobs cobs_test.c -o jf_cobs_test.exe
-gcc -L. -lscmbcobs cobs_test_scmb.c -o scmb_cobs_test.exe
+gcc cobs_test.c -L. -lcobs -lpthread -o cobs_test.exe
+gcc -DCOBS_TEST_SERVER cobs_test.c -L. -lcobs_server -lcobs -lpthread -o server_cobs_test.exe
+gcc -DCOBS_ENABLE_STATS cobs_test.c -L. -lcobs_stats -lpthread -o stats_cobs_test.exe
+gcc -DCOBS_TEST_CORE_ONLY cobs_test.c -L. -ljfcobs -o jf_cobs_test.exe
+gcc cobs_test_scmb.c -L. -lscmbcobs -o scmb_cobs_test.exe
+g++ -std=c++20 cobs_test_hpp.cpp -o hpp_cobs_test.exe
+gcc -O2 cobs_bench_parallel.c -L. -lcobs -lpthread -o cobs_bench_parallel.exe
+gcc -O2 cobs_bench_pool.c -L. -lcobs -lpthread -o cobs_bench_pool.exe
+gcc -O2 cobs_bench_queue.c -L. -lcobs -lpthread -o cobs_bench_queue.exe
+gcc -O2 cobs_bench_server.c -L. -lcobs_server -lcobs -lpthread -o cobs_bench_server.exe
+gcc -O2 cobs_bench.c -L. -lcobs -o cobs_bench.exe
+gcc -O2 -DCOBS_ENABLE_STATS cobs_bench.c -L. -lcobs_stats -lpthread -o stats_cobs_bench.exe
+gcc -O2 -DCOBS_BENCH_JF cobs_bench.c -L. -ljfcobs -o jf_cobs_bench.exe
+gcc -O2 -DCOBS_BENCH_SCMB cobs_bench.c -L. -lscmbcobs -o scmb_cobs_bench.exe
+gcc -O2 cobs_cli.c -L. -lcobs -o cobs.exe
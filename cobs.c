@@ -1,81 +1,1554 @@
 #include "cobs.h"
+#include "cobs_crc.h"
+#include "cobs_internal.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 
-// this macro replaces a NULL (or the header) with the ctr to next code_ptr
-#define FINISH_BLOCK(X, flag) (  block_flag = flag,     \
-                                 *code_ptr = (X),       \
-                                 code_ptr = output++,   \
-                                 code = 0x01       )
+#ifndef COBS_MAX_SIMD
+#define COBS_MAX_SIMD 2
+#endif
 
-size_t cobs_encode(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+#if COBS_TERMINATOR != 0x00
+#error "the stream, batch and in place paths only handle a 0x00 terminator; use cobs_encode_delim / cobs_decode_delim"
+#endif
+
+#if COBS_MAX_SIMD > 0 && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COBS_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define COBS_X86_SIMD 0
+#endif
+
+// the longest run of non-NULL bytes a single block can carry (code byte 0xFF)
+#define MAX_RUN 254
+
+// true if any of the 8 bytes in X is zero (exact: no false positives for the word as a whole)
+#define SWAR_ONES  0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+#define SWAR_HAS_ZERO(X) ((((X) - SWAR_ONES) & ~(X) & SWAR_HIGHS) != 0)
+
+// Stats (COBS_ENABLE_STATS). Each thread counts into a shard of its own, found through a thread local
+// pointer, so counting is a plain add to a cache line no other thread writes. The adds are relaxed atomic
+// stores only so that cobs_stats_read may load the counters from another thread; on the usual targets they
+// compile to ordinary moves. Shards are linked into a list for cobs_stats_read, and when a thread exits its
+// counts are folded into the retired totals. Without COBS_ENABLE_STATS the STAT_ macros are empty.
+#ifdef COBS_ENABLE_STATS
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct stats_shard
+{
+    cobs_stats counts;
+    struct stats_shard * next;
+    uint32_t sample;                                // frames (receiver: blocks) seen, for sampling block lengths
+} stats_shard;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static stats_shard * stats_shards = NULL;           // of the live threads
+static cobs_stats stats_retired;                    // of the threads gone
+static cobs_stats stats_baseline;                   // at the last cobs_stats_reset
+static __thread stats_shard * stats_mine = NULL;
+
+#define STATS_FIELDS (sizeof(cobs_stats) / sizeof(uint64_t))
+
+static void stats_sum(cobs_stats * total, const cobs_stats * counts)
+{
+    uint64_t * t = (uint64_t *)total;
+    const uint64_t * c = (const uint64_t *)counts;
+    for (size_t i = 0; i < STATS_FIELDS; i++) t[i] += __atomic_load_n(&c[i], __ATOMIC_RELAXED);
+}
+
+// everything counted so far; the caller holds stats_lock
+static void stats_total(cobs_stats * total)
+{
+    memset(total, 0, sizeof(*total));
+    stats_sum(total, &stats_retired);
+    for (stats_shard * shard = stats_shards; shard; shard = shard->next) stats_sum(total, &shard->counts);
+}
+
+static void stats_thread_exit(void * arg)
+{
+    stats_shard * shard = arg;
+    pthread_mutex_lock(&stats_lock);
+    stats_shard ** link = &stats_shards;
+    while (*link != shard) link = &(*link)->next;
+    *link = shard->next;
+    stats_sum(&stats_retired, &shard->counts);
+    pthread_mutex_unlock(&stats_lock);
+    // the codec may yet be called from another key's destructor on this thread; that registers a fresh shard
+    // (and sets the key again, so it is folded in too) rather than counting into this one once it is freed
+    stats_mine = NULL;
+    free(shard);
+}
+
+static void stats_make_key(void)
+{
+    pthread_key_create(&stats_key, stats_thread_exit);
+}
+
+static __attribute__((noinline)) stats_shard * stats_register(void)
+{
+    stats_shard * shard = calloc(1, sizeof(stats_shard));
+    if (shard == NULL) abort();
+    pthread_once(&stats_once, stats_make_key);
+    pthread_setspecific(stats_key, shard);
+    pthread_mutex_lock(&stats_lock);
+    shard->next = stats_shards;
+    stats_shards = shard;
+    pthread_mutex_unlock(&stats_lock);
+    stats_mine = shard;
+    return shard;
+}
+
+static inline stats_shard * stats_local(void)
+{
+    stats_shard * shard = stats_mine;
+    return __builtin_expect(shard != NULL, 1) ? shard : stats_register();
+}
+
+static inline void stat_add(uint64_t * counter, uint64_t n)
 {
-    const uint8_t * end = input + length;         // remember the end point
-    uint8_t * start_of_output = output;           // remember where we started
-    uint8_t * code_ptr = output++;                // initially, the header byte, thereafter the next NULL to replace
-    uint8_t code = 0x01;                          // count number of nun-NULL bytes
-    bool block_flag = false;                      // prevent doing FINISH_BLOCK twice for cerrtain edge cases
-                                                  // unit tests from wikipedia ex. 6 and 7 fail without this
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+// bit width of v, capped: the histogram bucket
+static inline size_t stat_bucket(size_t v, size_t buckets)
+{
+    size_t bucket = v ? 64 - (size_t)__builtin_clzll((unsigned long long)v) : 0;
+    return bucket < buckets ? bucket : buckets - 1;
+}
 
-    while(input < end)                            // loop over input
+static inline void stat_frame(stats_shard * st, bool encoded, size_t payload, size_t wire)
+{
+    if (encoded)
     {
-        block_flag = false;
-        if (*input == 0) FINISH_BLOCK(code, false);         // found a NULL? do what is needed.
-        else
+        stat_add(&st->counts.frames_encoded, 1);
+        stat_add(&st->counts.encode_bytes_in, payload);
+        stat_add(&st->counts.encode_bytes_out, wire);
+    }
+    else
+    {
+        stat_add(&st->counts.frames_decoded, 1);
+        stat_add(&st->counts.decode_bytes_in, wire);
+        stat_add(&st->counts.decode_bytes_out, payload);
+    }
+    stat_add(&st->counts.frame_sizes[stat_bucket(payload, COBS_STATS_SIZE_BUCKETS)], 1);
+}
+
+// Block lengths of a good frame, read back off its code bytes; only one frame in COBS_STATS_BLOCK_SAMPLE is
+// looked at, by a counter of the thread's own. Doing this after the fact, rather than in the block loops,
+// leaves the loops exactly as they are without stats.
+static inline bool stat_sampled(stats_shard * st)
+{
+    return st->sample++ % COBS_STATS_BLOCK_SAMPLE == 0;
+}
+
+static void stat_blocks(stats_shard * st, const uint8_t * frame, size_t length, uint8_t delimiter)
+{
+    const uint8_t * end = frame + length;
+    while (frame < end)
+    {
+        size_t n = (size_t)(*frame ^ delimiter) - 1;
+        if (n >= (size_t)(end - frame)) break;
+        stat_add(&st->counts.block_lengths[stat_bucket(n, COBS_STATS_BLOCK_BUCKETS)], 1);
+        frame += n + 1;
+    }
+}
+
+// The kernels' block loops carry no counting at all: the encode and decode entry points count from the result.
+// A decode that returned 0 has its frame walked again to tell a bad frame, and why, from an empty one; bad
+// frames are rare, so that costs nothing on the fast path.
+static __attribute__((noinline, cold)) int stat_diagnose(const uint8_t * input, size_t length, uint8_t delimiter)
+{
+    const uint8_t * end = input + length;
+    while (input < end)
+    {
+        uint8_t code = *input++ ^ delimiter;
+        size_t n = (size_t)code - 1;
+        if (code == 0) return COBS_FAIL_ZERO_CODE;
+        if (n > (size_t)(end - input)) return COBS_FAIL_OVERRUN;
+        for (size_t i = 0; i < n; i++)
         {
-            *output++ = *input;                             // just copy input to output and inc te counter
-            code++;
-            if (code == 0xFF) FINISH_BLOCK(code, true);     // if we hit this at the end, we do NOT want to do it again below!
+            if (input[i] == delimiter) return COBS_FAIL_EMBEDDED_ZERO;
         }
-        input++;
+        input += n;
     }
-    if (block_flag == false) FINISH_BLOCK(code, false);
-	
-#ifdef COBS_ENCODE_ADD_TERMINATOR
-    *code_ptr = 0;                                          // append the NULL byte
-    return code_ptr - start_of_output + 1;                  // return position of the NULL
+    return -1;                                              // good, and empty
+}
+
+static inline void stat_encode_result(const uint8_t * output, size_t length, size_t encoded, uint8_t delimiter)
+{
+    stats_shard * st = stats_local();
+    stat_frame(st, true, length, encoded);
+    if (stat_sampled(st)) stat_blocks(st, output, encoded, delimiter);
+}
+
+static inline void stat_decode_result(const uint8_t * input, size_t length, size_t decoded, uint8_t delimiter)
+{
+    stats_shard * st = stats_local();
+    int reason = decoded ? -1 : stat_diagnose(input, length, delimiter);
+    if (reason >= 0)
+    {
+        stat_add(&st->counts.decode_failures[reason], 1);
+        return;
+    }
+    stat_frame(st, false, decoded, length);
+    if (stat_sampled(st)) stat_blocks(st, input, length, delimiter);
+}
+
+#define STAT_ENCODE_RESULT(output, length, encoded, delimiter) stat_encode_result(output, length, encoded, delimiter)
+#define STAT_DECODE_RESULT(input, length, decoded, delimiter)  stat_decode_result(input, length, decoded, delimiter)
+#define STAT_DECODED(payload, wire)         stat_frame(stats_local(), false, payload, wire)
+#define STAT_FAILURE(reason)                stat_add(&stats_local()->counts.decode_failures[reason], 1)
+#define STAT_BLOCKS(frame, length, delimiter) \
+    do { stats_shard * st = stats_local(); if (stat_sampled(st)) stat_blocks(st, frame, length, delimiter); } while (0)
+#define STAT_BLOCK(n) \
+    do { stats_shard * st = stats_local(); if (stat_sampled(st)) stat_add(&st->counts.block_lengths[stat_bucket(n, COBS_STATS_BLOCK_BUCKETS)], 1); } while (0)
 #else
-    return code_ptr - start_of_output;                        // return position not including
+#define STAT_ENCODE_RESULT(output, length, encoded, delimiter) ((void)0)
+#define STAT_DECODE_RESULT(input, length, decoded, delimiter)  ((void)0)
+#define STAT_DECODED(payload, wire)         ((void)0)
+#define STAT_FAILURE(reason)                ((void)0)
+#define STAT_BLOCKS(frame, length, delimiter) ((void)0)
+#define STAT_BLOCK(n)                       ((void)0)
+#endif
+
+// Run kernels: copy src to dst until a NULL is found or n bytes have been copied, and return the
+// number of non-NULL bytes in front of the NULL (n if there is none). A kernel may store anything
+// from src[0..n) to dst[0..n) on the way - the block driver below only hands out ranges that are
+// inside the final encoded frame, and every byte in there is rewritten later on. Every byte stored
+// is XORed with key, which is the frame delimiter (0 for plain COBS): it rides along in the register
+// the data is already in, so a non-zero delimiter costs one XOR per vector.
+
+static inline size_t run_scalar(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    size_t i = 0;
+    while (i < n && src[i] != 0)
+    {
+        dst[i] = src[i] ^ key;
+        i++;
+    }
+    return i;
+}
+
+static size_t run_swar(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    const uint64_t keys = key * SWAR_ONES;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t word, stored;
+        memcpy(&word, src + i, 8);
+        stored = word ^ keys;
+        memcpy(dst + i, &stored, 8);
+        if (SWAR_HAS_ZERO(word)) break;                     // locate it byte by byte, endian neutral
+    }
+    return i + run_scalar(dst + i, src + i, n - i, key);
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static size_t run_sse2(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keys = _mm_set1_epi8((char)key);
+    size_t i = 0;
+
+    if (n < 16) return run_swar(dst, src, n, key);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, keys));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    if (i < n)                                              // overlapping load for the tail
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + n - 16));
+        _mm_storeu_si128((__m128i *)(dst + n - 16), _mm_xor_si128(v, keys));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) >> (16 - (n - i));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    return n;
+}
+
+#if COBS_MAX_SIMD > 1
+// Short runs go to the SSE2 kernel before anything touches a ymm register: the key broadcast would
+// otherwise be hoisted above the test, and legacy SSE code entered with a dirty upper half runs slowly.
+__attribute__((target("avx2"), noinline))
+static size_t run_avx2_long(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i keys = _mm256_set1_epi8((char)key);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, keys));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    if (i < n)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + n - 32));
+        _mm256_storeu_si256((__m256i *)(dst + n - 32), _mm256_xor_si256(v, keys));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) >> (32 - (n - i));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    return n;
+}
+
+__attribute__((target("avx2")))
+static size_t run_avx2(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    return n < 32 ? run_sse2(dst, src, n, key) : run_avx2_long(dst, src, n, key);
+}
+#endif
+#endif
+
+// The block driver, shared by all kernels. It produces exactly what the original byte loop did:
+//  - a run of 254 non-NULL bytes closes a block with code 0xFF, and no further block is opened
+//    if the input ends right there (wikipedia ex. 7 and 8),
+//  - otherwise every block is closed by a NULL or by the end of the input.
+// As before, code_ptr always ends up on the slot after the frame, where a terminator would go. With a
+// non-zero delimiter every byte of the frame is XORed with it, code bytes included, and the terminator
+// is the delimiter itself.
+static inline __attribute__((always_inline))
+size_t encode_blocks(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate,
+                     uint8_t delimiter, size_t (*run)(uint8_t * restrict, const uint8_t * restrict, size_t, uint8_t))
+{
+    const uint8_t * end = input + length;
+    uint8_t * code_ptr = output;                            // the header byte, thereafter the next NULL to replace
+    uint8_t * out = output + 1;
+
+    for (;;)
+    {
+        size_t avail = (size_t)(end - input);
+        if (avail > MAX_RUN) avail = MAX_RUN;
+        size_t n = run(out, input, avail, delimiter);
+        input += n;
+        out += n;
+        *code_ptr = (uint8_t)(n + 1) ^ delimiter;
+        code_ptr = out++;
+        if (input == end) break;
+        if (n != MAX_RUN) input++;                          // skip the NULL that closed this block
+    }
+
+    if (terminate)
+    {
+        *code_ptr = delimiter;                              // append the terminator
+        return code_ptr - output + 1;                       // return position of the NULL
+    }
+    return code_ptr - output;                               // return position not including
+}
+
+static size_t encode_swar(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate,
+                          uint8_t delimiter)
+{
+    return encode_blocks(input, length, output, terminate, delimiter, run_swar);
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static size_t encode_sse2(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate,
+                          uint8_t delimiter)
+{
+    return encode_blocks(input, length, output, terminate, delimiter, run_sse2);
+}
+
+#if COBS_MAX_SIMD > 1
+__attribute__((target("avx2")))
+static size_t encode_avx2(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate,
+                          uint8_t delimiter)
+{
+    return encode_blocks(input, length, output, terminate, delimiter, run_avx2);
+}
+#endif
+#endif
+
+// The batch encode driver: encode_blocks inlined once per message, terminator and all, so a message costs
+// no call and no kernel lookup. While one message is encoded the first lines of the one after next are
+// fetched; small messages from all over the heap are otherwise a cache miss each before the first byte.
+#define BATCH_PREFETCH_AHEAD 2                              // messages
+#define BATCH_PREFETCH_BYTES 256                            // of each, enough for most small messages
+
+static inline __attribute__((always_inline))
+size_t encode_batch_blocks(const struct iovec * messages, size_t count, uint8_t * restrict output, size_t * offsets,
+                           size_t (*run)(uint8_t * restrict, const uint8_t * restrict, size_t, uint8_t))
+{
+    uint8_t * out = output;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i + BATCH_PREFETCH_AHEAD < count)
+        {
+            const uint8_t * next = messages[i + BATCH_PREFETCH_AHEAD].iov_base;
+            size_t next_length = messages[i + BATCH_PREFETCH_AHEAD].iov_len;
+            if (next_length > BATCH_PREFETCH_BYTES) next_length = BATCH_PREFETCH_BYTES;
+            for (size_t line = 0; line < next_length; line += 64) __builtin_prefetch(next + line);
+        }
+        if (offsets) offsets[i] = (size_t)(out - output);
+        size_t encoded = encode_blocks(messages[i].iov_base, messages[i].iov_len, out, true, 0, run);
+        STAT_ENCODE_RESULT(out, messages[i].iov_len, encoded, 0);
+        out += encoded;
+    }
+    return (size_t)(out - output);
+}
+
+static size_t encode_batch_swar(const struct iovec * messages, size_t count, uint8_t * restrict output, size_t * offsets)
+{
+    return encode_batch_blocks(messages, count, output, offsets, run_swar);
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static size_t encode_batch_sse2(const struct iovec * messages, size_t count, uint8_t * restrict output, size_t * offsets)
+{
+    return encode_batch_blocks(messages, count, output, offsets, run_sse2);
+}
+
+#if COBS_MAX_SIMD > 1
+__attribute__((target("avx2")))
+static size_t encode_batch_avx2(const struct iovec * messages, size_t count, uint8_t * restrict output, size_t * offsets)
+{
+    return encode_batch_blocks(messages, count, output, offsets, run_avx2);
+}
+#endif
+#endif
+
+// Copy kernels for the decoder: copy exactly n bytes from src to dst (never storing outside
+// dst[0..n)), XORed with key as for the run kernels, and return true if any of them came out as
+// a NULL (was the delimiter). The check is folded into one compare per chunk and tested once at
+// the end of the run.
+
+static inline bool copy_scalar(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    uint8_t all = 0xFF;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t b = src[i] ^ key;
+        dst[i] = b;
+        all &= (uint8_t)-(b != 0);                          // stays 0xFF while every byte is non-NULL
+    }
+    return all == 0;
+}
+
+static bool copy_swar(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    const uint64_t keys = key * SWAR_ONES;
+    uint64_t zeros = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, src + i, 8);
+        word ^= keys;
+        memcpy(dst + i, &word, 8);
+        zeros |= (word - SWAR_ONES) & ~word & SWAR_HIGHS;
+    }
+    return zeros != 0 || copy_scalar(dst + i, src + i, n - i, key);
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static bool copy_sse2(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keys = _mm_set1_epi8((char)key);
+    __m128i zeros = zero;
+    size_t i = 0;
+
+    if (n < 16) return copy_swar(dst, src, n, key);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), keys);
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+        zeros = _mm_or_si128(zeros, _mm_cmpeq_epi8(v, zero));
+    }
+    if (i < n)                                              // overlapping load for the tail
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + n - 16)), keys);
+        _mm_storeu_si128((__m128i *)(dst + n - 16), v);
+        zeros = _mm_or_si128(zeros, _mm_cmpeq_epi8(v, zero));
+    }
+    return _mm_movemask_epi8(zeros) != 0;
+}
+
+#if COBS_MAX_SIMD > 1
+__attribute__((target("avx2"), noinline))
+static bool copy_avx2_long(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i keys = _mm256_set1_epi8((char)key);
+    __m256i zeros = zero;
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + i)), keys);
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+        zeros = _mm256_or_si256(zeros, _mm256_cmpeq_epi8(v, zero));
+    }
+    if (i < n)
+    {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + n - 32)), keys);
+        _mm256_storeu_si256((__m256i *)(dst + n - 32), v);
+        zeros = _mm256_or_si256(zeros, _mm256_cmpeq_epi8(v, zero));
+    }
+    return _mm256_movemask_epi8(zeros) != 0;
+}
+
+// split as run_avx2 is
+__attribute__((target("avx2")))
+static bool copy_avx2(uint8_t * restrict dst, const uint8_t * restrict src, size_t n, uint8_t key)
+{
+    return n < 32 ? copy_sse2(dst, src, n, key) : copy_avx2_long(dst, src, n, key);
+}
+#endif
+#endif
+
+// The decode driver, shared by all kernels. Returns 0 if the frame is invalid, which can be because
+// a code byte is NULL or points past the end of the input, or because a NULL turns up inside a block.
+// Each byte is XORed with the delimiter on the way in, so with a non-zero one "NULL" means the delimiter.
+static inline __attribute__((always_inline))
+size_t decode_blocks(const uint8_t * restrict input, size_t length, uint8_t * restrict output, uint8_t delimiter,
+                     bool (*copy)(uint8_t * restrict, const uint8_t * restrict, size_t, uint8_t))
+{
+    const uint8_t * end = input + length;
+    uint8_t * out = output;
+
+    while (input < end)
+    {
+        uint8_t code = *input++ ^ delimiter;
+        if (code == 0) return 0;                            // we can't be having NULL here, error
+        size_t n = (size_t)code - 1;
+        if (n > (size_t)(end - input)) return 0;            // overrun
+        if (copy(out, input, n, delimiter)) return 0;       // we can't be having NULL here, either
+        input += n;
+        out += n;
+        if (code != 0xFF && input != end) *out++ = 0;
+    }
+    return out - output;
+}
+
+static size_t decode_swar(const uint8_t * restrict input, size_t length, uint8_t * restrict output, uint8_t delimiter)
+{
+    return decode_blocks(input, length, output, delimiter, copy_swar);
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static size_t decode_sse2(const uint8_t * restrict input, size_t length, uint8_t * restrict output, uint8_t delimiter)
+{
+    return decode_blocks(input, length, output, delimiter, copy_sse2);
+}
+
+#if COBS_MAX_SIMD > 1
+__attribute__((target("avx2")))
+static size_t decode_avx2(const uint8_t * restrict input, size_t length, uint8_t * restrict output, uint8_t delimiter)
+{
+    return decode_blocks(input, length, output, delimiter, copy_avx2);
+}
+#endif
+#endif
+
+// Move kernels, for trusted decoding: the copy kernels without the NULL check and the XOR, same chunking
+// and overlapping tail, so again nothing is stored outside dst[0..n).
+static inline void move_swar(uint8_t * restrict dst, const uint8_t * restrict src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) memcpy(dst + i, src + i, 8);
+    for (; i < n; i++) dst[i] = src[i];
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static inline void move_sse2(uint8_t * restrict dst, const uint8_t * restrict src, size_t n)
+{
+    if (n < 16)
+    {
+        move_swar(dst, src, n);
+        return;
+    }
+    for (size_t i = 0; i + 16 <= n; i += 16)
+    {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i)));
+    }
+    _mm_storeu_si128((__m128i *)(dst + n - 16), _mm_loadu_si128((const __m128i *)(src + n - 16)));
+}
+
+#if COBS_MAX_SIMD > 1
+__attribute__((target("avx2"), noinline))
+static void move_avx2_long(uint8_t * restrict dst, const uint8_t * restrict src, size_t n)
+{
+    for (size_t i = 0; i + 32 <= n; i += 32)
+    {
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+    }
+    _mm256_storeu_si256((__m256i *)(dst + n - 32), _mm256_loadu_si256((const __m256i *)(src + n - 32)));
+}
+
+// split as run_avx2 is
+__attribute__((target("avx2")))
+static inline void move_avx2(uint8_t * restrict dst, const uint8_t * restrict src, size_t n)
+{
+    if (n < 32) move_sse2(dst, src, n);
+    else move_avx2_long(dst, src, n);
+}
+#endif
+#endif
+
+// The trusted decode driver: the blocks of decode_blocks, with nothing checked but that a code byte does
+// not point past the end of the input - which is one compare per block, and keeps a frame that is not
+// valid COBS after all from taking reads or writes out of bounds. Such a frame decodes to garbage, NULLs
+// and all; a NULL code byte is taken as a block running to the end of the frame.
+static inline __attribute__((always_inline))
+size_t decode_trusted_blocks(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                             void (*move)(uint8_t * restrict, const uint8_t * restrict, size_t))
+{
+    const uint8_t * end = input + length;
+    uint8_t * out = output;
+
+    while (input < end)
+    {
+        uint8_t code = *input++;
+        size_t n = (size_t)code - 1;
+        if (n > (size_t)(end - input)) n = (size_t)(end - input);
+        move(out, input, n);
+        input += n;
+        out += n;
+        if (code != 0xFF && input != end) *out++ = 0;
+    }
+    return out - output;
+}
+
+static size_t decode_trusted_swar(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    return decode_trusted_blocks(input, length, output, move_swar);
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static size_t decode_trusted_sse2(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    return decode_trusted_blocks(input, length, output, move_sse2);
+}
+
+#if COBS_MAX_SIMD > 1
+__attribute__((target("avx2")))
+static size_t decode_trusted_avx2(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    return decode_trusted_blocks(input, length, output, move_avx2);
+}
+#endif
+#endif
+
+// The batch driver: decodes every complete frame in a receive buffer in one pass. The run kernels stop
+// at the first NULL, so the end of each frame is found by the same scan that copies its blocks.
+static inline __attribute__((always_inline))
+size_t decode_batch_blocks(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                           cobs_frame * restrict frames, size_t max_frames, size_t * trailing,
+                           size_t (*run)(uint8_t * restrict, const uint8_t * restrict, size_t, uint8_t))
+{
+    const uint8_t * p = input;
+    const uint8_t * end = input + length;
+    const uint8_t * frame_start = p;
+    uint8_t * out = output;
+    size_t count = 0;
+
+    while (count < max_frames)
+    {
+        while (p < end && *p == 0) p++;                     // empty frames
+        frame_start = p;
+        if (p == end) break;
+
+        uint8_t * frame_out = out;
+        cobs_status status = COBS_OK;
+        uint8_t code = 0;
+        bool complete = false;
+        while (p < end)
+        {
+            if (*p == 0)                                    // terminator
+            {
+                complete = true;
+                break;
+            }
+            if (code != 0 && code != 0xFF) *out++ = 0;      // the previous block ended with a NULL
+            code = *p++;
+            size_t want = (size_t)code - 1;
+            size_t avail = (size_t)(end - p);
+            if (avail > want) avail = want;
+            size_t n = run(out, p, avail, 0);
+            out += n;
+            p += n;
+            if (n < avail)                                  // the frame ends inside this block
+            {
+                status = COBS_ERR_OVERRUN;
+                complete = true;
+                break;
+            }
+            if (n < want) break;                            // out of input
+        }
+        if (!complete)
+        {
+            out = frame_out;
+            break;
+        }
+        p++;                                                // the terminator
+        if (status != COBS_OK)
+        {
+            out = frame_out;                                // nothing to keep from a bad frame
+            STAT_FAILURE(COBS_FAIL_OVERRUN);
+        }
+        else
+        {
+            STAT_DECODED((size_t)(out - frame_out), (size_t)(p - frame_start));
+            STAT_BLOCKS(frame_start, (size_t)(p - 1 - frame_start), 0);
+        }
+        frames[count].offset = (size_t)(frame_out - output);
+        frames[count].length = (size_t)(out - frame_out);
+        frames[count].status = status;
+        count++;
+        frame_start = p;
+    }
+
+    *trailing = (size_t)(end - frame_start);
+    return count;
+}
+
+static size_t decode_batch_swar(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                                cobs_frame * restrict frames, size_t max_frames, size_t * trailing)
+{
+    return decode_batch_blocks(input, length, output, frames, max_frames, trailing, run_swar);
+}
+
+#if COBS_X86_SIMD
+__attribute__((target("sse2")))
+static size_t decode_batch_sse2(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                                cobs_frame * restrict frames, size_t max_frames, size_t * trailing)
+{
+    return decode_batch_blocks(input, length, output, frames, max_frames, trailing, run_sse2);
+}
+
+#if COBS_MAX_SIMD > 1
+__attribute__((target("avx2")))
+static size_t decode_batch_avx2(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                                cobs_frame * restrict frames, size_t max_frames, size_t * trailing)
+{
+    return decode_batch_blocks(input, length, output, frames, max_frames, trailing, run_avx2);
+}
+#endif
 #endif
+
+typedef size_t (*run_fn)(uint8_t * restrict, const uint8_t * restrict, size_t, uint8_t);
+typedef bool (*copy_fn)(uint8_t * restrict, const uint8_t * restrict, size_t, uint8_t);
+typedef size_t (*encode_fn)(const uint8_t * restrict, size_t, uint8_t * restrict, bool, uint8_t);
+typedef size_t (*decode_fn)(const uint8_t * restrict, size_t, uint8_t * restrict, uint8_t);
+typedef size_t (*batch_fn)(const uint8_t * restrict, size_t, uint8_t * restrict, cobs_frame * restrict, size_t, size_t *);
+typedef size_t (*trusted_fn)(const uint8_t * restrict, size_t, uint8_t * restrict);
+typedef size_t (*encode_batch_fn)(const struct iovec *, size_t, uint8_t * restrict, size_t *);
+
+typedef struct
+{
+    run_fn run;
+    copy_fn copy;
+    encode_fn encode;
+    decode_fn decode;
+    batch_fn decode_batch;
+    trusted_fn decode_trusted;
+    encode_batch_fn encode_batch;
+} kernel_table;
+
+static const kernel_table swar_kernels = { run_swar, copy_swar, encode_swar, decode_swar, decode_batch_swar,
+                                           decode_trusted_swar, encode_batch_swar };
+#if COBS_X86_SIMD
+static const kernel_table sse2_kernels = { run_sse2, copy_sse2, encode_sse2, decode_sse2, decode_batch_sse2,
+                                           decode_trusted_sse2, encode_batch_sse2 };
+#if COBS_MAX_SIMD > 1
+static const kernel_table avx2_kernels = { run_avx2, copy_avx2, encode_avx2, decode_avx2, decode_batch_avx2,
+                                           decode_trusted_avx2, encode_batch_avx2 };
+#endif
+#endif
+
+// Resolved on the first call. Every thread resolves to the same table, so threads racing on the first call
+// may each do the work, but the pointer itself is loaded and stored atomically.
+static const kernel_table * kernels = NULL;
+
+static const kernel_table * get_kernels(void)
+{
+    const kernel_table * k = __atomic_load_n(&kernels, __ATOMIC_ACQUIRE);
+    if (k) return k;
+    k = &swar_kernels;
+#if COBS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) k = &sse2_kernels;
+#if COBS_MAX_SIMD > 1
+    if (__builtin_cpu_supports("avx2")) k = &avx2_kernels;
+#endif
+#endif
+    __atomic_store_n(&kernels, k, __ATOMIC_RELEASE);
+    return k;
+}
+
+size_t cobs_encode(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    size_t encoded = get_kernels()->encode(input, length, output, COBS_ENCODE_TERMINATES, 0);
+    STAT_ENCODE_RESULT(output, length, encoded, 0);
+    return encoded;
+}
+
+size_t cobs_encode_frame(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate)
+{
+    size_t encoded = get_kernels()->encode(input, length, output, terminate, 0);
+    STAT_ENCODE_RESULT(output, length, encoded, 0);
+    return encoded;
+}
+
+size_t cobs_encode_uncounted(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate)
+{
+    return get_kernels()->encode(input, length, output, terminate, 0);
+}
+
+void cobs_stats_count_encode(const uint8_t * output, size_t length, size_t encoded)
+{
+    STAT_ENCODE_RESULT(output, length, encoded, 0);
+#ifndef COBS_ENABLE_STATS
+    (void)output;
+    (void)length;
+    (void)encoded;
+#endif
+}
+
+size_t cobs_encode_batch(const struct iovec * messages, size_t count, uint8_t * restrict output, size_t * offsets)
+{
+    return get_kernels()->encode_batch(messages, count, output, offsets);
+}
+
+size_t cobs_encode_delim(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                         uint8_t delimiter, bool terminate)
+{
+    size_t encoded = get_kernels()->encode(input, length, output, terminate, delimiter);
+    STAT_ENCODE_RESULT(output, length, encoded, delimiter);
+    return encoded;
+}
+
+// The block loop of encode_blocks with nothing copied: a code byte per block plus every non-NULL byte.
+size_t cobs_encoded_length(const uint8_t * input, size_t length)
+{
+    const uint8_t * end = input + length;
+    size_t blocks = 0;
+    size_t nulls = 0;
+
+    for (;;)
+    {
+        size_t avail = (size_t)(end - input);
+        if (avail > MAX_RUN) avail = MAX_RUN;
+        const uint8_t * null = memchr(input, 0, avail);
+        size_t n = null ? (size_t)(null - input) : avail;
+        input += n;
+        blocks++;
+        if (input == end) break;
+        if (n != MAX_RUN)
+        {
+            input++;
+            nulls++;
+        }
+    }
+    return blocks + (length - nulls) + (COBS_ENCODE_TERMINATES ? 1 : 0);
 }
 
 size_t cobs_decode(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
 {
-    size_t read_index = 0;
-    size_t write_index = 0;
-    uint8_t code;
-    uint8_t i;
+    size_t decoded = get_kernels()->decode(input, length, output, 0);
+    STAT_DECODE_RESULT(input, length, decoded, 0);
+    return decoded;
+}
+
+size_t cobs_decode_delim(const uint8_t * restrict input, size_t length, uint8_t * restrict output, uint8_t delimiter)
+{
+    size_t decoded = get_kernels()->decode(input, length, output, delimiter);
+    STAT_DECODE_RESULT(input, length, decoded, delimiter);
+    return decoded;
+}
+
+// The deferred check, done before a single byte is decoded: memchr (vectorised in any libc worth the name)
+// for a NULL anywhere in the frame, then a walk along the code bytes alone to see that the last block ends
+// exactly at the end of the frame. Whatever passes is valid COBS, so the trusted driver decodes it.
+static bool frame_valid(const uint8_t * input, size_t length)
+{
+    if (memchr(input, 0, length) != NULL) return false;
+    const uint8_t * end = input + length;
+    while (input < end)
+    {
+        size_t n = (size_t)*input++ - 1;
+        if (n > (size_t)(end - input)) return false;       // overrun
+        input += n;
+    }
+    return true;
+}
+
+size_t cobs_decode_validated(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                             cobs_validation validation)
+{
+    size_t decoded;
+    if (validation == COBS_VALIDATE_STRICT) decoded = get_kernels()->decode(input, length, output, 0);
+    else if (validation == COBS_VALIDATE_DEFERRED && !frame_valid(input, length)) decoded = 0;
+    else decoded = get_kernels()->decode_trusted(input, length, output);
+    STAT_DECODE_RESULT(input, length, decoded, 0);
+    return decoded;
+}
+
+size_t cobs_decode_batch(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                         cobs_frame * restrict frames, size_t max_frames, size_t * trailing)
+{
+    return get_kernels()->decode_batch(input, length, output, frames, max_frames, trailing);
+}
+
+// The write position never gets ahead of the read position: each block gives back its code byte and
+// takes at most one implied NULL, so everything written has been read already. Blocks are moved with
+// memmove, since the wide kernels load their tail after storing the body and source and destination
+// are usually only one byte apart here.
+size_t cobs_decode_inplace(uint8_t * buffer, size_t length)
+{
+    const uint8_t * input = buffer;
+    const uint8_t * end = buffer + length;
+    uint8_t * out = buffer;
+    STAT_BLOCKS(buffer, length, 0);                     // while the code bytes are still there
 
-    while(read_index < length)
+    while (input < end)
     {
-        code = input[read_index];
-        if(read_index + code > length && code != 1) // overrun
+        uint8_t code = *input++;
+        size_t n = (size_t)code - 1;
+        if (code == 0)                                      // we can't be having NULL here, error
         {
+            STAT_FAILURE(COBS_FAIL_ZERO_CODE);
             return 0;
         }
-        if (code == 0)  // we can't be having NULL here, error
+        if (n > (size_t)(end - input))                      // overrun
         {
+            STAT_FAILURE(COBS_FAIL_OVERRUN);
             return 0;
         }
-        read_index++;
-        for(i = 1; i < code; i++)
+        if (memchr(input, 0, n) != NULL)                    // we can't be having NULL here, either
         {
-            uint8_t data_byte = input[read_index++];
-            if (data_byte == 0)
+            STAT_FAILURE(COBS_FAIL_EMBEDDED_ZERO);
+            return 0;
+        }
+        memmove(out, input, n);
+        input += n;
+        out += n;
+        if (code != 0xFF && input != end) *out++ = 0;
+    }
+    STAT_DECODED((size_t)(out - buffer), length);
+    return out - buffer;
+}
+
+// The same blocks as encode_blocks. With the payload COBS_ENCODE_HEADROOM bytes in, every byte is
+// written no further along than where it was read from, so - as for cobs_decode_inplace - the runs
+// are found with memchr and moved with memmove rather than by the wide kernels.
+size_t cobs_encode_inplace(uint8_t * buffer, size_t headroom, size_t length)
+{
+    if (headroom < COBS_ENCODE_HEADROOM(length)) return 0;
+
+    const uint8_t * input = buffer + headroom;
+    const uint8_t * end = input + length;
+    uint8_t * code_ptr = buffer;
+    uint8_t * out = buffer + 1;
+
+    for (;;)
+    {
+        size_t avail = (size_t)(end - input);
+        if (avail > MAX_RUN) avail = MAX_RUN;
+        const uint8_t * null = memchr(input, 0, avail);
+        size_t n = null ? (size_t)(null - input) : avail;
+        memmove(out, input, n);
+        input += n;
+        out += n;
+        *code_ptr = (uint8_t)(n + 1);
+        code_ptr = out++;
+        if (input == end) break;
+        if (n != MAX_RUN) input++;                          // skip the NULL that closed this block
+    }
+
+#ifdef COBS_ENCODE_ADD_TERMINATOR
+    *code_ptr = 0;
+    return code_ptr - buffer + 1;
+#else
+    return code_ptr - buffer;
+#endif
+}
+
+// encode_blocks over the logical concatenation of the segments: the open block (code_ptr and the count
+// of bytes in it) simply carries on into the next segment, wherever the segment boundaries fall.
+size_t cobs_encodev(const struct iovec * iov, int iovcnt, uint8_t * restrict output)
+{
+    run_fn run = get_kernels()->run;
+    uint8_t * code_ptr = output;
+    uint8_t * out = output + 1;
+    size_t count = 0;                                       // bytes in the open block
+    bool block_flag = false;                                // as in cobs_encode: last block closed by a 254 byte run
+
+    for (int seg = 0; seg < iovcnt; seg++)
+    {
+        const uint8_t * input = iov[seg].iov_base;
+        const uint8_t * end = input + iov[seg].iov_len;
+        while (input < end)
+        {
+            size_t avail = (size_t)(end - input);
+            if (avail > MAX_RUN - count) avail = MAX_RUN - count;
+            size_t n = run(out, input, avail, 0);
+            input += n;
+            out += n;
+            count += n;
+            block_flag = false;
+            if (count == MAX_RUN)
             {
-                return 0; // we can't be having NULL here, either
+                block_flag = true;
+            }
+            else if (n == avail)                            // end of this segment, the block stays open
+            {
+                break;
             }
             else
             {
-                output[write_index++] = data_byte;
+                input++;                                    // skip the NULL that closes this block
             }
+            *code_ptr = (uint8_t)(count + 1);
+            code_ptr = out++;
+            count = 0;
+        }
+    }
+    if (block_flag == false)
+    {
+        *code_ptr = (uint8_t)(count + 1);
+        code_ptr = out;
+    }
+
+#ifdef COBS_ENCODE_ADD_TERMINATOR
+    *code_ptr = 0;
+    return code_ptr - output + 1;
+#else
+    return code_ptr - output;
+#endif
+}
+
+// encode_blocks, except that once the rest of the input fits in one block, the run kernel is stopped a
+// byte short of the end. If the input does end in that block, its last byte is looked at by hand: when it
+// is at least the code byte it would follow, it is stored as the code byte instead (so the code points past
+// the end of the frame), and nothing is ever written past the returned length.
+size_t cobs_encode_reduced(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate)
+{
+    run_fn run = get_kernels()->run;
+    const uint8_t * end = input + length;
+    uint8_t * code_ptr = output;
+    uint8_t * out = output + 1;
+
+    for (;;)
+    {
+        size_t remaining = (size_t)(end - input);
+        if (remaining > MAX_RUN)
+        {
+            size_t n = run(out, input, MAX_RUN, 0);
+            input += n;
+            out += n;
+            *code_ptr = (uint8_t)(n + 1);
+            code_ptr = out++;
+            if (n != MAX_RUN) input++;                      // skip the NULL that closed this block
+            continue;
         }
-        if(code != 0xFF && read_index != length)
+        if (remaining == 0)                                 // the input ended with a NULL
         {
-            output[write_index++] = '\0';
+            *code_ptr = 1;
+            code_ptr = out;
+            break;
         }
+        size_t n = run(out, input, remaining - 1, 0);
+        uint8_t last = input[n];
+        if (n == remaining - 1 && last != 0)                // the last block, n + 1 bytes long
+        {
+            if (last >= n + 2)
+            {
+                *code_ptr = last;
+                code_ptr = out + n;
+            }
+            else
+            {
+                out[n] = last;
+                *code_ptr = (uint8_t)(n + 2);
+                code_ptr = out + n + 1;
+            }
+            break;
+        }
+        input += n + 1;                                     // closed by a NULL at input[n]
+        out += n;
+        *code_ptr = (uint8_t)(n + 1);
+        code_ptr = out++;
+    }
+
+    if (terminate)
+    {
+        *code_ptr = 0;
+        return code_ptr - output + 1;
+    }
+    return code_ptr - output;
+}
+
+// decode_blocks, except that a code byte pointing past the end of the frame is the reduced last block:
+// the rest of the frame is its data, and the code byte itself is the last byte of the payload.
+size_t cobs_decode_reduced(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    copy_fn copy = get_kernels()->copy;
+    const uint8_t * end = input + length;
+    uint8_t * out = output;
+
+    while (input < end)
+    {
+        uint8_t code = *input++;
+        if (code == 0) return 0;                            // we can't be having NULL here, error
+        size_t n = (size_t)code - 1;
+        if (n > (size_t)(end - input))                      // the reduced last block
+        {
+            n = (size_t)(end - input);
+            if (copy(out, input, n, 0)) return 0;
+            out[n] = code;
+            return out + n + 1 - output;
+        }
+        if (copy(out, input, n, 0)) return 0;               // we can't be having NULL here, either
+        input += n;
+        out += n;
+        if (code != 0xFF && input != end) *out++ = 0;
     }
+    return out - output;
+}
 
-    return write_index;
+// When the worst case frame fits between head and the end of the ring, this is just cobs_encode_frame at
+// ring + head. Otherwise it is encode_blocks with positions taken modulo capacity: a run that reaches the
+// end of the ring is finished at its start, and a code byte is written by index once its block is closed,
+// wherever the block ended up. Every byte stored lies inside the frame, which has been checked to fit.
+size_t cobs_encode_ring(const uint8_t * restrict input, size_t length, uint8_t * restrict ring, size_t capacity,
+                        size_t head, size_t free_bytes, bool terminate)
+{
+    const kernel_table * k = get_kernels();
+    size_t need = COBS_ENCODE_MAX_LENGTH(length) - (terminate ? 0 : 1);
+    if (need > free_bytes)
+    {
+        need = cobs_encoded_length(input, length) - (COBS_ENCODE_TERMINATES ? 1 : 0) + (terminate ? 1 : 0);
+        if (need > free_bytes) return COBS_RING_FULL;
+    }
+    if (head + need <= capacity)
+    {
+        head += k->encode(input, length, ring + head, terminate, 0);
+        return head == capacity ? 0 : head;
+    }
+
+    const uint8_t * end = input + length;
+    size_t code_pos = head;
+    size_t pos = head + 1 == capacity ? 0 : head + 1;
+
+    for (;;)
+    {
+        size_t avail = (size_t)(end - input);
+        if (avail > MAX_RUN) avail = MAX_RUN;
+        size_t first = capacity - pos < avail ? capacity - pos : avail;
+        size_t n = k->run(ring + pos, input, first, 0);
+        if (n == first && first < avail) n += k->run(ring, input + first, avail - first, 0);
+        input += n;
+        pos = (pos + n) % capacity;
+        ring[code_pos] = (uint8_t)(n + 1);
+        code_pos = pos;
+        pos = pos + 1 == capacity ? 0 : pos + 1;
+        if (input == end) break;
+        if (n != MAX_RUN) input++;                          // skip the NULL that closed this block
+    }
+
+    if (terminate)
+    {
+        ring[code_pos] = 0;
+        return pos;
+    }
+    return code_pos;
+}
+
+// Bytes the CRC of cobs_encode_crc / cobs_decode_crc is let fall behind the copy before it catches up:
+// enough that the call and the byte tail are paid once per chunk rather than once per block, small enough
+// that the chunk is still in L1.
+#define CRC_CHUNK 1024
+
+static uint32_t crc_init(cobs_crc_kind kind)
+{
+    return kind == COBS_CRC32C ? 0 : COBS_CRC16_INIT;
+}
+
+static uint32_t crc_update(cobs_crc_kind kind, uint32_t crc, const uint8_t * data, size_t length)
+{
+    return kind == COBS_CRC32C ? cobs_crc32c(crc, data, length) : cobs_crc16_ccitt((uint16_t)crc, data, length);
+}
+
+static void put_crc(cobs_crc_kind kind, uint32_t crc, uint8_t * dst)
+{
+    if (kind == COBS_CRC32C)
+    {
+        for (int i = 0; i < 4; i++) dst[i] = (uint8_t)(crc >> (8 * i));
+    }
+    else
+    {
+        dst[0] = (uint8_t)(crc >> 8);
+        dst[1] = (uint8_t)crc;
+    }
+}
+
+static uint32_t get_crc(cobs_crc_kind kind, const uint8_t * src)
+{
+    if (kind == COBS_CRC32C)
+    {
+        return (uint32_t)src[0] | (uint32_t)src[1] << 8 | (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+    }
+    return (uint32_t)src[0] << 8 | src[1];
+}
+
+// The blocks of cobs_encodev over two segments, the payload and its CRC, copied by the run kernel. The
+// payload read so far goes through the CRC every CRC_CHUNK bytes, while it is still in L1.
+size_t cobs_encode_crc(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                       cobs_crc_kind kind, bool append, bool terminate, uint32_t * crc)
+{
+    run_fn run = get_kernels()->run;
+    uint8_t tail[4];
+    const uint8_t * segments[2] = { input, tail };
+    size_t lengths[2] = { length, 0 };
+    uint32_t value = crc_init(kind);
+    const uint8_t * checked = input;                        // the CRC has been taken over input[0 .. checked)
+    uint8_t * code_ptr = output;
+    uint8_t * out = output + 1;
+    size_t count = 0;                                       // bytes in the open block
+    bool block_flag = false;                                // as in cobs_encode: last block closed by a 254 byte run
+
+    for (int seg = 0; seg < 2; seg++)
+    {
+        if (seg == 1)
+        {
+            value = crc_update(kind, value, checked, (size_t)(input + length - checked));
+            if (!append) break;
+            put_crc(kind, value, tail);
+            lengths[1] = COBS_CRC_SIZE(kind);
+        }
+        const uint8_t * in = segments[seg];
+        const uint8_t * end = in + lengths[seg];
+        while (in < end)
+        {
+            size_t avail = (size_t)(end - in);
+            if (avail > MAX_RUN - count) avail = MAX_RUN - count;
+            size_t n = run(out, in, avail, 0);
+            if (seg == 0 && (size_t)(in - checked) >= CRC_CHUNK)
+            {
+                value = crc_update(kind, value, checked, (size_t)(in - checked));
+                checked = in;
+            }
+            in += n;
+            out += n;
+            count += n;
+            block_flag = false;
+            if (count == MAX_RUN)
+            {
+                block_flag = true;
+            }
+            else if (n == avail)                            // end of this segment, the block stays open
+            {
+                break;
+            }
+            else
+            {
+                in++;                                       // skip the NULL that closes this block
+            }
+            *code_ptr = (uint8_t)(count + 1);
+            code_ptr = out++;
+            count = 0;
+        }
+    }
+    if (block_flag == false)
+    {
+        *code_ptr = (uint8_t)(count + 1);
+        code_ptr = out;
+    }
+
+    if (crc) *crc = value;
+    if (terminate)
+    {
+        *code_ptr = 0;
+        return code_ptr - output + 1;
+    }
+    return code_ptr - output;
+}
+
+// The blocks of decode_blocks, copied by the copy kernel. The CRC follows the write position CRC_CHUNK
+// bytes at a time, and at the end holds back the last bytes written when they are the CRC itself.
+cobs_status cobs_decode_crc(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                            cobs_crc_kind kind, bool verify, size_t * decoded_length, uint32_t * crc)
+{
+    copy_fn copy = get_kernels()->copy;
+    size_t width = verify ? COBS_CRC_SIZE(kind) : 0;
+    const uint8_t * end = input + length;
+    uint8_t * out = output;
+    uint8_t * checked = output;                             // the CRC has been taken over output[0 .. checked)
+    uint32_t value = crc_init(kind);
+
+    *decoded_length = 0;
+    if (length == 0)
+    {
+        STAT_FAILURE(COBS_FAIL_OVERRUN);
+        return COBS_ERR_OVERRUN;
+    }
+    while (input < end)
+    {
+        uint8_t code = *input++;
+        size_t n = (size_t)code - 1;
+        if (code == 0)                                      // we can't be having NULL here, error
+        {
+            STAT_FAILURE(COBS_FAIL_ZERO_CODE);
+            return COBS_ERR_OVERRUN;
+        }
+        if (n > (size_t)(end - input))
+        {
+            STAT_FAILURE(COBS_FAIL_OVERRUN);
+            return COBS_ERR_OVERRUN;
+        }
+        if (copy(out, input, n, 0))                         // we can't be having NULL here, either
+        {
+            STAT_FAILURE(COBS_FAIL_EMBEDDED_ZERO);
+            return COBS_ERR_OVERRUN;
+        }
+        input += n;
+        out += n;
+        if (code != 0xFF && input != end) *out++ = 0;
+        if ((size_t)(out - checked) >= CRC_CHUNK + width)
+        {
+            value = crc_update(kind, value, checked, (size_t)(out - checked) - width);
+            checked = out - width;
+        }
+    }
+
+    size_t total = out - output;
+    if (total < width)
+    {
+        STAT_FAILURE(COBS_FAIL_CRC);
+        return COBS_ERR_CRC;
+    }
+    value = crc_update(kind, value, checked, (size_t)(out - checked) - width);
+    if (crc) *crc = value;
+    if (verify && get_crc(kind, out - width) != value)
+    {
+        STAT_FAILURE(COBS_FAIL_CRC);
+        return COBS_ERR_CRC;
+    }
+    *decoded_length = total - width;
+    STAT_DECODED(total - width, length);
+    STAT_BLOCKS(end - length, length, 0);
+    return COBS_OK;
+}
+
+void cobs_encoder_init(cobs_encoder * enc)
+{
+    enc->pending = 0;
+    enc->block_flag = false;
+}
+
+// Each block is closed the moment its NULL (or 254th byte) arrives. While the input holds at least a
+// whole block the data is encoded straight into the output, only a block still open at the end of
+// the chunk is parked in enc->block.
+size_t cobs_encoder_update(cobs_encoder * restrict enc, const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    run_fn run = get_kernels()->run;
+    const uint8_t * end = input + length;
+    uint8_t * out = output;
+
+    while (input < end)
+    {
+        size_t remaining = (size_t)(end - input);
+        size_t n;
+
+        if (enc->pending == 0 && remaining >= MAX_RUN)
+        {
+            n = run(out + 1, input, MAX_RUN, 0);
+            input += n;
+            *out = (uint8_t)(n + 1);
+            out += n + 1;
+        }
+        else
+        {
+            size_t avail = MAX_RUN - enc->pending;
+            if (avail > remaining) avail = remaining;
+            n = run(enc->block + enc->pending, input, avail, 0);
+            input += n;
+            enc->pending += (uint8_t)n;
+            if (n == avail && enc->pending != MAX_RUN)      // out of input, block stays open
+            {
+                enc->block_flag = false;
+                break;
+            }
+            n = enc->pending;
+            *out++ = (uint8_t)(n + 1);
+            memcpy(out, enc->block, n);
+            out += n;
+            enc->pending = 0;
+        }
+        enc->block_flag = (n == MAX_RUN);
+        if (n != MAX_RUN) input++;                          // skip the NULL that closed this block
+    }
+    return out - output;
+}
+
+size_t cobs_encoder_finish(cobs_encoder * restrict enc, uint8_t * restrict output, bool terminate)
+{
+    size_t written = 0;
+    if (enc->block_flag == false)
+    {
+        output[written++] = enc->pending + 1;
+        memcpy(output + written, enc->block, enc->pending);
+        written += enc->pending;
+    }
+    if (terminate) output[written++] = COBS_TERMINATOR;
+    cobs_encoder_init(enc);
+    return written;
+}
+
+void cobs_receiver_init(cobs_receiver * rx, uint8_t * buffer, size_t capacity)
+{
+    rx->buffer = buffer;
+    rx->capacity = capacity;
+    rx->length = 0;
+    rx->code = 0;
+    rx->remaining = 0;
+    rx->discarding = false;
+}
+
+// Terminators are found with memchr, so the data between two of them is known to be NULL free and
+// each block can be copied in one go, however the chunk boundaries fall.
+cobs_status cobs_receiver_feed(cobs_receiver * restrict rx, const uint8_t * restrict input, size_t length, size_t * consumed)
+{
+    const uint8_t * p = input;
+    const uint8_t * end = input + length;
+    cobs_status status = COBS_INCOMPLETE;
+
+    while (p < end)
+    {
+        if (rx->discarding)                                 // resync: drop everything up to the next terminator
+        {
+            const uint8_t * t = memchr(p, COBS_TERMINATOR, (size_t)(end - p));
+            if (t == NULL)
+            {
+                p = end;
+                break;
+            }
+            p = t + 1;
+            rx->discarding = false;
+            rx->code = 0;
+            rx->remaining = 0;
+        }
+        else if (*p == COBS_TERMINATOR)
+        {
+            p++;
+            if (rx->code == 0) continue;                    // empty frame, nothing to report
+            status = rx->remaining ? COBS_ERR_OVERRUN : COBS_OK;
+            if (status == COBS_OK) STAT_DECODED(rx->length, 0);
+            else STAT_FAILURE(COBS_FAIL_OVERRUN);
+            rx->code = 0;
+            rx->remaining = 0;
+            break;
+        }
+        else if (rx->remaining == 0)                        // a code byte
+        {
+            if (rx->code == 0)
+            {
+                rx->length = 0;
+            }
+            else if (rx->code != 0xFF)                      // the previous block ended with a NULL
+            {
+                if (rx->length == rx->capacity)
+                {
+                    status = COBS_ERR_OVERFLOW;
+                    STAT_FAILURE(COBS_FAIL_OVERFLOW);
+                    rx->discarding = true;
+                    break;
+                }
+                rx->buffer[rx->length++] = 0;
+            }
+            rx->code = *p++;
+            rx->remaining = rx->code - 1;
+            STAT_BLOCK(rx->remaining);
+        }
+        else                                                // data: copy up to the end of the block
+        {
+            size_t n = (size_t)(end - p);
+            if (n > rx->remaining) n = rx->remaining;
+            const uint8_t * t = memchr(p, COBS_TERMINATOR, n);
+            if (t != NULL) n = (size_t)(t - p);
+            if (n > rx->capacity - rx->length)
+            {
+                status = COBS_ERR_OVERFLOW;
+                STAT_FAILURE(COBS_FAIL_OVERFLOW);
+                rx->discarding = true;
+                break;
+            }
+            memcpy(rx->buffer + rx->length, p, n);
+            rx->length += n;
+            rx->remaining -= (uint8_t)n;
+            p += n;
+        }
+    }
+
+    *consumed = (size_t)(p - input);
+#ifdef COBS_ENABLE_STATS
+    stat_add(&stats_local()->counts.decode_bytes_in, *consumed);   // input counts as it arrives, not per frame
+#endif
+    return status;
+}
+
+void cobs_receiver_process(cobs_receiver * restrict rx, const uint8_t * restrict input, size_t length,
+                           cobs_frame_handler handler, void * context)
+{
+    while (length > 0)
+    {
+        size_t consumed;
+        cobs_status status = cobs_receiver_feed(rx, input, length, &consumed);
+        input += consumed;
+        length -= consumed;
+        if (status == COBS_OK) handler(context, status, rx->buffer, rx->length);
+        else if (status != COBS_INCOMPLETE) handler(context, status, NULL, 0);
+    }
+}
+
+bool cobs_stats_read(cobs_stats * stats)
+{
+    memset(stats, 0, sizeof(*stats));
+#ifdef COBS_ENABLE_STATS
+    pthread_mutex_lock(&stats_lock);
+    stats_total(stats);
+    uint64_t * t = (uint64_t *)stats;
+    const uint64_t * b = (const uint64_t *)&stats_baseline;
+    for (size_t i = 0; i < STATS_FIELDS; i++) t[i] -= b[i];
+    pthread_mutex_unlock(&stats_lock);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// The other threads' counters are theirs alone to write, so a reset just moves the baseline that reads
+// are taken from.
+void cobs_stats_reset(void)
+{
+#ifdef COBS_ENABLE_STATS
+    pthread_mutex_lock(&stats_lock);
+    stats_total(&stats_baseline);
+    pthread_mutex_unlock(&stats_lock);
+#endif
+}
+
+double cobs_stats_overhead(const cobs_stats * stats)
+{
+    if (stats->encode_bytes_in == 0) return 0;
+    return (double)stats->encode_bytes_out / (double)stats->encode_bytes_in - 1;
 }
@@ -9,18 +9,73 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#ifdef _WIN32
+struct iovec
+{
+    void * iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
 
-// in principle it SHOULD be possible to define a terminator other than zero but this has not been tested.
+// the terminator used by the API below. It must be 0x00 (cobs.c will not build otherwise); a link that uses another
+// delimiter should use cobs_encode_delim / cobs_decode_delim, which take it at runtime.
 #define COBS_TERMINATOR 0x00
 
 // #define COBS_ENCODE_ADD_TERMINATOR
 
+#ifdef COBS_ENCODE_ADD_TERMINATOR
+#define COBS_ENCODE_TERMINATES true
+#else
+#define COBS_ENCODE_TERMINATES false
+#endif
+
+// outcome of the frame level API. Plain cobs_decode still just returns 0 for a bad frame.
+typedef enum
+{
+    COBS_OK = 0,
+    COBS_INCOMPLETE,        // all input consumed, the frame is not finished yet
+    COBS_ERR_OVERRUN,       // a code byte points past the end of the frame
+    COBS_ERR_OVERFLOW,      // the decoded frame does not fit the buffer
+    COBS_ERR_CRC,           // the frame decoded, but its CRC does not match (cobs_crc.h)
+    COBS_CLOSED,            // the port has hung up or failed, and no more frames will come (cobs_server.h)
+} cobs_status;
+
+// the encoder and decoder pick the widest kernel the CPU supports at runtime (AVX2, SSE2 or a portable 64-bit
+// SWAR loop). Define COBS_MAX_SIMD to cap that choice: 0 = SWAR only, 1 = up to SSE2, 2 = up to AVX2.
+// #define COBS_MAX_SIMD 0
+
 // ENCODE length bytes from the input, and return the number of bytes in the encoded output.
 // if COBS_ENCODE_ADD_TERMINATOR is defined, the return value will include that otherwise it 
 // is the responsibility of the caller to assign output[length] = 0. It is also the responsibility
-// of the caller to ensure that a vuffer of sufficient size has been allocated.
+// of the caller to ensure that a buffer of sufficient size has been allocated.
 size_t cobs_encode(const uint8_t * restrict input, size_t length, uint8_t * restrict output);
 
+// ENCODE as above, but with the terminator appended (or not) as chosen at runtime rather than by
+// COBS_ENCODE_ADD_TERMINATOR. Nothing is written past the returned length.
+size_t cobs_encode_frame(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate);
+
+// the exact number of bytes cobs_encode will return for this input, for sizing buffers ahead of encoding.
+// It scans the input without writing anything, so it costs a fraction of the encode itself.
+size_t cobs_encoded_length(const uint8_t * input, size_t length);
+
+// the most bytes cobs_encode can return for length bytes of any input, terminator included: one code byte per
+// 254 bytes of payload, one more for the last block, and the terminator.
+#define COBS_ENCODE_MAX_LENGTH(length) ((length) + (length) / 254 + 2)
+
+// ENCODE into a circular transmit buffer of capacity bytes at ring, starting at ring[head], and wrapping round to
+// ring[0] as often as it takes - in the middle of a block, or between a code byte and the block it counts. Only
+// free_bytes bytes from head on are free to use. Returns the new head (just past the frame, and its terminator if
+// terminate is true), or COBS_RING_FULL, without touching the ring, if the frame needs more than free_bytes.
+// When the worst case size (COBS_ENCODE_MAX_LENGTH) does not fit, the exact size is found first with
+// cobs_encoded_length, which costs a scan of the input.
+#define COBS_RING_FULL SIZE_MAX
+
+size_t cobs_encode_ring(const uint8_t * restrict input, size_t length, uint8_t * restrict ring, size_t capacity,
+                        size_t head, size_t free_bytes, bool terminate);
+
 // DECODE length bytes of input. In this case it is expected that the receive code has already detected
 // the trailing 0, and it need not be included in the input. Returns the number of bytes in the decoded 
 // output, or 0 if the input is not valid, which can occur for one of two reasons:
@@ -28,4 +83,183 @@ size_t cobs_encode(const uint8_t * restrict input, size_t length, uint8_t * rest
 //   2. a "marker byte" points past the end of the input buffer.
 size_t cobs_decode(const uint8_t * restrict input, size_t length, uint8_t * restrict output);
 
+// DECODE with a choice of how much checking the input gets. For frames the wire could have mangled, STRICT is
+// cobs_decode itself. For frames known to be good - written by this program, or read back from storage that has
+// its own CRC - TRUSTED drops the NULL check on every byte and checks only that each code byte stays inside the
+// frame, so a bad frame decodes to garbage rather than to 0 (but never out of bounds). DEFERRED checks the whole
+// frame first, in one pass for a NULL anywhere and one walk along the code bytes, and then decodes it as TRUSTED
+// does; it returns what STRICT does. Output needs room for length bytes, as for cobs_decode.
+typedef enum
+{
+    COBS_VALIDATE_STRICT,
+    COBS_VALIDATE_TRUSTED,
+    COBS_VALIDATE_DEFERRED,
+} cobs_validation;
+
+size_t cobs_decode_validated(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                             cobs_validation validation);
+
+// ENCODE / DECODE with a delimiter chosen at runtime (0x7E, 0xFF ...). The frame is the one cobs_encode_frame gives
+// with every byte XORed with the delimiter - since that frame holds no NULL, this one holds no delimiter - and the
+// terminator, if asked for, is the delimiter itself. The XOR rides along in the copy loops, so any delimiter runs
+// at the speed of plain COBS; with delimiter 0 these are the same as cobs_encode_frame and cobs_decode. The decoder
+// returns 0 for an invalid frame as cobs_decode does, a delimiter inside the frame taking the place of a NULL.
+size_t cobs_encode_delim(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                         uint8_t delimiter, bool terminate);
+size_t cobs_decode_delim(const uint8_t * restrict input, size_t length, uint8_t * restrict output, uint8_t delimiter);
+
+// ENCODE / DECODE COBS/R (reduced), which saves the last code byte of most small frames. When the last byte of the
+// payload is at least the code byte of the block it ends, it takes that code byte's place and the frame is one
+// byte shorter; the decoder knows it happened because the code then points past the end of the frame. Otherwise
+// the frame is the one cobs_encode_frame gives, so the encoded length is never more than plain COBS. The decoder
+// returns 0 for an invalid frame as cobs_decode does, except that a code byte pointing past the end can not be
+// told from a reduced one - the price of the saved byte. Output needs room for length bytes, as for cobs_decode.
+size_t cobs_encode_reduced(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate);
+size_t cobs_decode_reduced(const uint8_t * restrict input, size_t length, uint8_t * restrict output);
+
+// SCATTER-GATHER ENCODE of the concatenation of iovcnt segments (e.g. header, payload and CRC), without first
+// copying them together. Same output and return value as cobs_encode of the concatenated data.
+size_t cobs_encodev(const struct iovec * iov, int iovcnt, uint8_t * restrict output);
+
+// BATCH ENCODE of count messages, back to back into one buffer with a terminator after each, so that the
+// lot can go out in a single write(). The kernel is chosen once for the batch and the next messages are
+// prefetched while one is encoded, which is most of the cost of a small message. If offsets is not NULL,
+// offsets[i] is set to where the frame of message i starts in the output; it runs up to the terminator just
+// before offsets[i + 1] (or the returned length, for the last). Returns the number of bytes written, which
+// needs room for COBS_ENCODE_MAX_LENGTH(iov_len) bytes per message.
+size_t cobs_encode_batch(const struct iovec * messages, size_t count, uint8_t * restrict output, size_t * offsets);
+
+// ENCODE IN PLACE. The payload sits at buffer + headroom, and the encoded frame is written over it starting at
+// buffer[0], so a transmit path needs only the one buffer. headroom must be at least COBS_ENCODE_HEADROOM(length),
+// and buffer must hold headroom + length bytes (one more if COBS_ENCODE_ADD_TERMINATOR is defined). Returns the
+// same as cobs_encode, with the same output, or 0 if the headroom is too small.
+#define COBS_ENCODE_HEADROOM(length) (1 + (length) / 254)
+
+size_t cobs_encode_inplace(uint8_t * buffer, size_t headroom, size_t length);
+
+// DECODE IN PLACE: as cobs_decode, with the decoded frame written over the encoded one at the start of buffer.
+// Decoding never needs more room than the input, so nothing past buffer[length - 1] is touched; bytes between
+// the decoded and the encoded length are left with scratch. Same return value as cobs_decode.
+size_t cobs_decode_inplace(uint8_t * buffer, size_t length);
+
+// BATCH DECODE of a receive buffer holding many frames, each followed by a terminator. Every complete frame
+// is decoded into the output arena (which needs room for length bytes) in a single pass over the input, and
+// described in frames[]: where its payload starts in output, how long it is, and COBS_OK or
+// COBS_ERR_OVERRUN (in which case length is 0). Empty frames are skipped. Returns the number of descriptors
+// filled in. *trailing is set to the number of bytes at the end of the input that were not used - an
+// unfinished last frame, or the frames that did not fit in max_frames - which should be passed in again,
+// in front of the next read.
+typedef struct
+{
+    size_t offset;          // start of the decoded frame in the output arena
+    size_t length;          // decoded length
+    cobs_status status;
+} cobs_frame;
+
+size_t cobs_decode_batch(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                         cobs_frame * restrict frames, size_t max_frames, size_t * trailing);
+
+// STREAMING ENCODE. The same encoding as cobs_encode, but the payload may be handed over in chunks of
+// any size, and each block is written out as soon as it is closed. Only the block still open at the end
+// of a chunk (at most 253 bytes) is kept in the encoder, so memory per stream is bounded.
+typedef struct
+{
+    uint8_t block[254];     // data of the open block, waiting for its code byte
+    uint8_t pending;        // number of bytes in block[]
+    bool block_flag;        // the last block was closed by a 254 byte run, as in cobs_encode
+} cobs_encoder;
+
+// room the output of one cobs_encoder_update call needs, for a chunk of length bytes
+#define COBS_ENCODER_UPDATE_BOUND(length) ((length) + (length) / 254 + 255)
+
+void cobs_encoder_init(cobs_encoder * enc);
+
+// ENCODE length more bytes of payload. Returns the number of encoded bytes written to output, which must
+// have room for COBS_ENCODER_UPDATE_BOUND(length) bytes; anything past the returned count may be scratch.
+size_t cobs_encoder_update(cobs_encoder * restrict enc, const uint8_t * restrict input, size_t length, uint8_t * restrict output);
+
+// close the last block (at most 255 bytes, plus the terminator if terminate is true) and reset the encoder
+// for the next frame. The concatenated output of update and finish equals cobs_encode of the whole payload.
+size_t cobs_encoder_finish(cobs_encoder * restrict enc, uint8_t * restrict output, bool terminate);
+
+// RECEIVE. Reassembles and decodes frames from a byte stream read in chunks of any size (e.g. straight from
+// read() on a serial port). Frames are delimited by COBS_TERMINATOR and decoded on the fly into the caller's
+// buffer, so no frame buffer or allocation is needed on top of it. After a bad frame the receiver drops
+// everything up to the next terminator and carries on. Empty frames (back to back terminators) are skipped.
+typedef struct
+{
+    uint8_t * buffer;       // the caller's buffer, receives the decoded frame
+    size_t capacity;
+    size_t length;          // decoded bytes in buffer
+    uint8_t code;           // code byte of the current block, 0 between frames
+    uint8_t remaining;      // data bytes still due in the current block
+    bool discarding;        // skipping to the next terminator after an error
+} cobs_receiver;
+
+void cobs_receiver_init(cobs_receiver * rx, uint8_t * buffer, size_t capacity);
+
+// FEED length bytes. Stops at the end of the first frame that completes, and sets *consumed to the number
+// of bytes used, so the rest of the input should be fed again. Returns
+//   COBS_OK           - a frame is ready: rx->buffer[0 .. rx->length), valid until the next call
+//   COBS_INCOMPLETE   - all input consumed without finishing a frame
+//   COBS_ERR_OVERRUN  - a frame ended in the middle of a block, and was dropped
+//   COBS_ERR_OVERFLOW - a frame did not fit the buffer, and is being dropped
+cobs_status cobs_receiver_feed(cobs_receiver * restrict rx, const uint8_t * restrict input, size_t length, size_t * consumed);
+
+// the same, but every frame (and every error, with frame = NULL) is handed to a callback and all of the
+// input is consumed
+typedef void (*cobs_frame_handler)(void * context, cobs_status status, const uint8_t * frame, size_t length);
+void cobs_receiver_process(cobs_receiver * restrict rx, const uint8_t * restrict input, size_t length,
+                           cobs_frame_handler handler, void * context);
+
+// STATS. Built with COBS_ENABLE_STATS defined, the codec counts what it does: frames and bytes each way, the
+// payload size of each frame, the length of each block and why each bad frame was bad. Every thread counts into
+// its own counters, without locks or shared cache lines, and cobs_stats_read adds up those of all threads
+// (threads that have exited included) when asked. Without COBS_ENABLE_STATS all of it is compiled out of the
+// codec, and cobs_stats_read returns false. Counted are the encode and decode kernels (cobs_encode,
+// cobs_encode_frame, cobs_encode_delim, cobs_decode, cobs_decode_delim and everything built on them),
+// cobs_decode_batch, cobs_decode_inplace, cobs_decode_crc and the receiver.
+typedef enum
+{
+    COBS_FAIL_ZERO_CODE,        // a code byte is NULL
+    COBS_FAIL_OVERRUN,          // a code byte points past the end of the frame
+    COBS_FAIL_EMBEDDED_ZERO,    // a NULL inside a block
+    COBS_FAIL_OVERFLOW,         // the decoded frame does not fit the buffer
+    COBS_FAIL_CRC,              // the CRC does not match
+    COBS_FAIL_REASONS
+} cobs_fail_reason;
+
+// histogram buckets: 0 counts zero, bucket i counts values in [2^(i-1), 2^i), and the last bucket everything
+// larger. Block lengths are data bytes per block (code byte - 1), so 128 .. 254 share the last bucket.
+#define COBS_STATS_SIZE_BUCKETS 25
+#define COBS_STATS_BLOCK_BUCKETS 9
+
+// Counting every block would cost far more than counting every frame when blocks are short, so block lengths
+// are sampled: only the blocks of one frame in COBS_STATS_BLOCK_SAMPLE (of the receiver, one block in that
+// many) are counted. Define it as 1 to count them all.
+#ifndef COBS_STATS_BLOCK_SAMPLE
+#define COBS_STATS_BLOCK_SAMPLE 16
+#endif
+
+typedef struct
+{
+    uint64_t frames_encoded;
+    uint64_t encode_bytes_in;           // payload
+    uint64_t encode_bytes_out;          // encoded, terminators included
+    uint64_t frames_decoded;            // good frames only
+    uint64_t decode_bytes_in;
+    uint64_t decode_bytes_out;
+    uint64_t decode_failures[COBS_FAIL_REASONS];
+    uint64_t frame_sizes[COBS_STATS_SIZE_BUCKETS];      // payload sizes, encoded and decoded frames
+    uint64_t block_lengths[COBS_STATS_BLOCK_BUCKETS];   // encoded and decoded blocks, sampled (see above)
+} cobs_stats;
+
+// READ the counts since the start (or the last cobs_stats_reset) into *stats. Returns false, with *stats
+// zeroed, when stats are compiled out. Counts still being made by other threads may or may not be included.
+bool cobs_stats_read(cobs_stats * stats);
+void cobs_stats_reset(void);
+
+// encoding overhead: encoded bytes per payload byte, minus 1 (0.004 is 0.4%), or 0 before anything is encoded
+double cobs_stats_overhead(const cobs_stats * stats);
+
 #endif
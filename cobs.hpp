@@ -0,0 +1,170 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_HPP
+#define COBS_HPP
+
+// Header-only C++ (17 or later) COBS, everything constexpr, so a fixed frame written out in the source is
+// encoded by the compiler:
+//
+//     constexpr std::array<uint8_t, 3> ping{ 0x01, 0x00, 0x02 };
+//     constexpr auto ping_frame = cobs::encode<0x7E>(ping);        // ping_frame.data(), ping_frame.size()
+//
+// The encoding is the same as cobs_encode's (without the terminator appended). For a terminator other than
+// zero, every encoded byte is XORed with it: a COBS encoded frame has no zero in it, so the XORed frame has
+// no terminator in it, and the decoder XORs it back. The terminator is a template parameter, so with the
+// default of zero the XOR is not there at all, and otherwise it is an immediate folded into each store.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+namespace cobs
+{
+
+// the most bytes encode can produce for length bytes of input (no terminator)
+constexpr std::size_t max_encoded_size(std::size_t length)
+{
+    return length + length / 254 + 1;
+}
+
+// a fixed capacity result: the first size() bytes of data() are the frame
+template <std::size_t Capacity>
+struct buffer
+{
+    std::array<std::uint8_t, Capacity> bytes{};
+    std::size_t length = 0;
+
+    constexpr const std::uint8_t * data() const { return bytes.data(); }
+    constexpr std::size_t size() const { return length; }
+    constexpr const std::uint8_t * begin() const { return bytes.data(); }
+    constexpr const std::uint8_t * end() const { return bytes.data() + length; }
+    constexpr std::uint8_t operator[](std::size_t i) const { return bytes[i]; }
+};
+
+// ENCODE length bytes of input into output, which needs room for max_encoded_size(length) bytes. Returns
+// the number of bytes written; the caller appends the terminator.
+template <std::uint8_t Terminator = 0>
+constexpr std::size_t encode(const std::uint8_t * input, std::size_t length, std::uint8_t * output)
+{
+    std::size_t code_index = 0;
+    std::size_t write_index = 1;
+    std::uint8_t code = 1;
+    bool block_flag = false;            // the last block was closed by a 254 byte run
+
+    for (std::size_t i = 0; i < length; i++)
+    {
+        block_flag = false;
+        if (input[i] != 0)
+        {
+            output[write_index++] = input[i] ^ Terminator;
+            if (++code != 0xFF) continue;
+            block_flag = true;
+        }
+        output[code_index] = code ^ Terminator;
+        code_index = write_index++;
+        code = 1;
+    }
+    if (block_flag) return code_index;
+    output[code_index] = code ^ Terminator;
+    return write_index;
+}
+
+// the exact number of bytes encode will return for this input
+constexpr std::size_t encoded_length(const std::uint8_t * input, std::size_t length)
+{
+    std::size_t encoded = 1;
+    std::size_t run = 0;
+    bool block_flag = false;
+
+    for (std::size_t i = 0; i < length; i++)
+    {
+        block_flag = false;
+        if (input[i] != 0 && ++run != 254)
+        {
+            encoded++;
+            continue;
+        }
+        encoded += input[i] != 0 ? 2 : 1;
+        block_flag = input[i] != 0;
+        run = 0;
+    }
+    return block_flag ? encoded - 1 : encoded;
+}
+
+// DECODE length bytes of a frame (its terminator already stripped) into output, which needs room for
+// length bytes. Returns the decoded length, or 0 if the frame is invalid: a terminator inside it, or a
+// code byte pointing past its end - the same as cobs_decode.
+template <std::uint8_t Terminator = 0>
+constexpr std::size_t decode(const std::uint8_t * input, std::size_t length, std::uint8_t * output)
+{
+    std::size_t read_index = 0;
+    std::size_t write_index = 0;
+
+    while (read_index < length)
+    {
+        std::uint8_t code = input[read_index++] ^ Terminator;
+        if (code == 0) return 0;
+        if (read_index + code - 1 > length) return 0;
+        for (std::uint8_t i = 1; i < code; i++)
+        {
+            std::uint8_t byte = input[read_index++] ^ Terminator;
+            if (byte == 0) return 0;
+            output[write_index++] = byte;
+        }
+        if (code != 0xFF && read_index != length) output[write_index++] = 0;
+    }
+    return write_index;
+}
+
+template <std::uint8_t Terminator = 0, std::size_t N>
+constexpr buffer<max_encoded_size(N)> encode(const std::array<std::uint8_t, N> & input)
+{
+    buffer<max_encoded_size(N)> result;
+    result.length = encode<Terminator>(input.data(), N, result.bytes.data());
+    return result;
+}
+
+template <std::uint8_t Terminator = 0, std::size_t N>
+constexpr buffer<N> decode(const std::array<std::uint8_t, N> & input)
+{
+    buffer<N> result;
+    result.length = decode<Terminator>(input.data(), N, result.bytes.data());
+    return result;
+}
+
+template <std::size_t N>
+constexpr std::size_t encoded_length(const std::array<std::uint8_t, N> & input)
+{
+    return encoded_length(input.data(), N);
+}
+
+#if __cplusplus >= 202002L
+// the same over spans; output must have room as above, and the return value is the number of bytes written
+template <std::uint8_t Terminator = 0>
+constexpr std::size_t encode(std::span<const std::uint8_t> input, std::span<std::uint8_t> output)
+{
+    return encode<Terminator>(input.data(), input.size(), output.data());
+}
+
+template <std::uint8_t Terminator = 0>
+constexpr std::size_t decode(std::span<const std::uint8_t> input, std::span<std::uint8_t> output)
+{
+    return decode<Terminator>(input.data(), input.size(), output.data());
+}
+
+constexpr std::size_t encoded_length(std::span<const std::uint8_t> input)
+{
+    return encoded_length(input.data(), input.size());
+}
+#endif
+
+}
+
+#endif
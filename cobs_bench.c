@@ -0,0 +1,333 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+
+// Encode and decode throughput of one implementation, as CSV on stdout. Like cobs_test.c it is built once
+// per implementation: against cobs.c as it stands, against cobs_jf.c with COBS_BENCH_JF defined, and
+// against cobs_scmb.c (stuff_data / unstuff_data) with COBS_BENCH_SCMB defined - see build.bat.
+//
+//     impl,op,cache,size,wire_size,zero_pct,frames,bytes,seconds,GB_per_s,ns_per_frame,cycles_per_byte
+//
+// Payloads run from 8 B to 64 MB, with 0% to 100% of their bytes zero. "warm" runs the same frame over and
+// over; "cold" walks through copies of it spread over COLD_SPAN bytes (more than any last level cache), or
+// for frames that big on their own, sweeps an eviction buffer before each one (outside the timing). Sizes
+// and rates are of the payload, so encode and decode rows compare directly. Cycles are TSC ticks, which run
+// at the nominal clock on current x86 parts; they are 0 on other targets.
+// The cobs.c build also times cobs_encode_delim / cobs_decode_delim (op encode_delim / decode_delim) with
+// delimiter 0x7E, which should match the plain rows, and COBS/ZPE (op encode_zpe / decode_zpe). wire_size is
+// the encoded length of the frame, so comparing it between the plain and the zpe rows at each zero_pct gives
+// the bytes zero pair elimination saves on the wire. The plain frames are decoded again by
+// cobs_decode_validated with TRUSTED and DEFERRED validation (op decode_trusted / decode_deferred), against
+// the decode rows, which are STRICT. Last come CRC-16/CCITT and CRC-32C, computed inside the encoder or
+// decoder by cobs_encode_crc / cobs_decode_crc (op encode_crc16 ...) against a separate CRC pass over the
+// payload before encoding or after decoding (op encode+crc16 ...). Built with COBS_ENABLE_STATS, against a
+// cobs.c built the same way, the rows say impl cobs_stats, so comparing them with the cobs rows gives the
+// cost of counting; the counts themselves are summed up on stderr at the end.
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#define CYCLES() 0ull
+#endif
+
+#ifdef COBS_BENCH_SCMB
+#include "cobs_scmb.h"
+#define IMPL "scmb"
+static size_t encode(const uint8_t * input, size_t length, uint8_t * output)
+{
+    stuff_data(input, length, output);
+    return output[0];
+}
+static size_t decode(const uint8_t * input, size_t length, uint8_t * output)
+{
+    unstuff_data(input, length, output);
+    return output[0];
+}
+#else
+#include "cobs.h"
+#ifdef COBS_BENCH_JF
+#define IMPL "jf"
+#elif defined(COBS_ENABLE_STATS)
+#define IMPL "cobs_stats"
+#else
+#define IMPL "cobs"
+#endif
+#define encode cobs_encode
+#define decode cobs_decode
+#if !defined(COBS_BENCH_JF)
+#include "cobs_zpe.h"
+#include "cobs_crc.h"
+#define BENCH_ZPE
+#define BENCH_CRC
+#define BENCH_DELIM 0x7E                   // also time cobs_encode_delim / cobs_decode_delim with this delimiter
+static size_t encode_delim(const uint8_t * input, size_t length, uint8_t * output)
+{
+    return cobs_encode_delim(input, length, output, BENCH_DELIM, false);
+}
+static size_t decode_delim(const uint8_t * input, size_t length, uint8_t * output)
+{
+    return cobs_decode_delim(input, length, output, BENCH_DELIM);
+}
+#define BENCH_VALIDATION
+static size_t decode_trusted(const uint8_t * input, size_t length, uint8_t * output)
+{
+    return cobs_decode_validated(input, length, output, COBS_VALIDATE_TRUSTED);
+}
+static size_t decode_deferred(const uint8_t * input, size_t length, uint8_t * output)
+{
+    return cobs_decode_validated(input, length, output, COBS_VALIDATE_DEFERRED);
+}
+#endif
+#endif
+
+typedef size_t (*codec_fn)(const uint8_t * input, size_t length, uint8_t * output);
+
+#ifdef BENCH_CRC
+static uint32_t crc_sink;
+
+static uint32_t crc_of(cobs_crc_kind kind, const uint8_t * data, size_t length)
+{
+    return kind == COBS_CRC32C ? cobs_crc32c(0, data, length) : cobs_crc16_ccitt(COBS_CRC16_INIT, data, length);
+}
+static size_t encode_crc(const uint8_t * input, size_t length, uint8_t * output, cobs_crc_kind kind)
+{
+    uint32_t crc;
+    size_t n = cobs_encode_crc(input, length, output, kind, false, false, &crc);
+    crc_sink += crc;
+    return n;
+}
+static size_t encode_then_crc(const uint8_t * input, size_t length, uint8_t * output, cobs_crc_kind kind)
+{
+    crc_sink += crc_of(kind, input, length);
+    return cobs_encode(input, length, output);
+}
+static size_t decode_crc(const uint8_t * input, size_t length, uint8_t * output, cobs_crc_kind kind)
+{
+    uint32_t crc;
+    size_t n;
+    cobs_decode_crc(input, length, output, kind, false, &n, &crc);
+    crc_sink += crc;
+    return n;
+}
+static size_t decode_then_crc(const uint8_t * input, size_t length, uint8_t * output, cobs_crc_kind kind)
+{
+    size_t n = cobs_decode(input, length, output);
+    crc_sink += crc_of(kind, output, n);
+    return n;
+}
+static size_t encode_crc16(const uint8_t * i, size_t n, uint8_t * o) { return encode_crc(i, n, o, COBS_CRC16_CCITT); }
+static size_t encode_then_crc16(const uint8_t * i, size_t n, uint8_t * o) { return encode_then_crc(i, n, o, COBS_CRC16_CCITT); }
+static size_t decode_crc16(const uint8_t * i, size_t n, uint8_t * o) { return decode_crc(i, n, o, COBS_CRC16_CCITT); }
+static size_t decode_then_crc16(const uint8_t * i, size_t n, uint8_t * o) { return decode_then_crc(i, n, o, COBS_CRC16_CCITT); }
+static size_t encode_crc32c(const uint8_t * i, size_t n, uint8_t * o) { return encode_crc(i, n, o, COBS_CRC32C); }
+static size_t encode_then_crc32c(const uint8_t * i, size_t n, uint8_t * o) { return encode_then_crc(i, n, o, COBS_CRC32C); }
+static size_t decode_crc32c(const uint8_t * i, size_t n, uint8_t * o) { return decode_crc(i, n, o, COBS_CRC32C); }
+static size_t decode_then_crc32c(const uint8_t * i, size_t n, uint8_t * o) { return decode_then_crc(i, n, o, COBS_CRC32C); }
+
+static const struct
+{
+    const char * op;
+    codec_fn codec;
+} crc_ops[] = {
+    { "encode_crc16", encode_crc16 }, { "encode+crc16", encode_then_crc16 },
+    { "decode_crc16", decode_crc16 }, { "decode+crc16", decode_then_crc16 },
+    { "encode_crc32c", encode_crc32c }, { "encode+crc32c", encode_then_crc32c },
+    { "decode_crc32c", decode_crc32c }, { "decode+crc32c", decode_then_crc32c },
+};
+#endif
+
+#define MAX_SIZE ((size_t)64 * 1024 * 1024)
+#define COLD_SPAN ((size_t)64 * 1024 * 1024)
+#define TARGET_BYTES ((size_t)64 * 1024 * 1024)    // payload bytes to put through each measurement
+#define MIN_FRAMES 3
+#define MAX_ENCODED(length) ((length) + (length) / 222 + 2)     // room for COBS or COBS/ZPE, either
+
+static const unsigned zero_pcts[] = { 0, 1, 10, 50, 100 };
+
+static uint8_t * input;                    // COLD_SPAN / size copies of the payload, size bytes apart
+static uint8_t * encoded;                  // the same number of copies of its encoding, MAX_ENCODED(size) apart
+static uint8_t * output;
+static uint8_t * evict;
+static volatile size_t sink;
+
+static uint32_t rand_state = 1;
+static uint32_t rand_next(void)
+{
+    rand_state = rand_state * 1103515245u + 12345u;
+    return rand_state >> 8;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the plain encoding, done here so that every implementation decodes exactly the same frames
+static size_t reference_encode(const uint8_t * in, size_t length, uint8_t * out)
+{
+    size_t code_index = 0, write_index = 1;
+    uint8_t code = 1;
+    bool closed_by_ff = false;
+    for (size_t i = 0; i < length; i++)
+    {
+        closed_by_ff = false;
+        if (in[i] != 0)
+        {
+            out[write_index++] = in[i];
+            if (++code != 0xFF) continue;
+            closed_by_ff = true;
+        }
+        out[code_index] = code;
+        code_index = write_index++;
+        code = 1;
+    }
+    if (!closed_by_ff)
+    {
+        out[code_index] = code;
+        code_index = write_index;
+    }
+    return code_index;
+}
+
+static void measure(const char * op, codec_fn codec, bool cold, size_t size, unsigned zero_pct, size_t encoded_length)
+{
+    size_t copies = cold && size < COLD_SPAN ? COLD_SPAN / size : 1;
+    size_t frames = TARGET_BYTES / size;
+    if (frames < MIN_FRAMES) frames = MIN_FRAMES;
+    if (cold && copies > 1 && frames < copies) frames = copies;     // at least one full sweep
+    bool encoding = op[0] == 'e';
+    const uint8_t * source = encoding ? input : encoded;
+    size_t source_length = encoding ? size : encoded_length;
+    size_t source_stride = encoding ? size : MAX_ENCODED(size);
+    size_t stride = MAX_ENCODED(size);
+
+    double seconds = 0;
+    uint64_t cycles = 0;
+    size_t result = 0;
+    if (cold && copies == 1)
+    {
+        for (size_t f = 0; f < frames; f++)
+        {
+            memset(evict, (int)f, COLD_SPAN);
+            double start = now();
+            uint64_t c0 = CYCLES();
+            result += codec(source, source_length, output);
+            cycles += CYCLES() - c0;
+            seconds += now() - start;
+        }
+    }
+    else
+    {
+        // warm up (for cold, this leaves the start of the sweep evicted by its end)
+        for (size_t k = 0; k < copies; k++) result += codec(source + k * source_stride, source_length, output + k * stride);
+        double start = now();
+        uint64_t c0 = CYCLES();
+        for (size_t f = 0, k = 0; f < frames; f++)
+        {
+            result += codec(source + k * source_stride, source_length, output + k * stride);
+            if (++k == copies) k = 0;
+        }
+        cycles = CYCLES() - c0;
+        seconds = now() - start;
+    }
+    sink += result;
+#ifdef BENCH_CRC
+    sink += crc_sink;
+#endif
+
+    double bytes = (double)size * frames;
+    printf("%s,%s,%s,%lu,%lu,%u,%lu,%.0f,%.6f,%.3f,%.1f,%.3f\n", IMPL, op, cold ? "cold" : "warm", (unsigned long)size,
+           (unsigned long)encoded_length, zero_pct, (unsigned long)frames, bytes, seconds, bytes / seconds / 1e9, seconds * 1e9 / frames,
+           (double)cycles / bytes);
+    fflush(stdout);
+}
+
+int main(void)
+{
+    size_t encoded_span = (COLD_SPAN / 8) * MAX_ENCODED(8);         // the most any size needs
+    input = malloc(COLD_SPAN > MAX_SIZE ? COLD_SPAN : MAX_SIZE);
+    encoded = malloc(encoded_span);
+    output = malloc(encoded_span);
+    evict = malloc(COLD_SPAN);
+    if (input == NULL || encoded == NULL || output == NULL || evict == NULL) return 1;
+
+    printf("impl,op,cache,size,wire_size,zero_pct,frames,bytes,seconds,GB_per_s,ns_per_frame,cycles_per_byte\n");
+    for (size_t d = 0; d < sizeof(zero_pcts) / sizeof(zero_pcts[0]); d++)
+    {
+        for (size_t size = 8; size <= MAX_SIZE; size *= size < MAX_SIZE / 2 ? 4 : 2)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                uint8_t b = (uint8_t)rand_next();
+                input[i] = rand_next() % 100 < zero_pcts[d] ? 0 : (b ? b : 1);
+            }
+            size_t stride = MAX_ENCODED(size);
+            size_t copies = size < COLD_SPAN ? COLD_SPAN / size : 1;
+            size_t encoded_length = reference_encode(input, size, encoded);
+            for (size_t k = 1; k < copies; k++)
+            {
+                memcpy(input + k * size, input, size);
+                memcpy(encoded + k * stride, encoded, encoded_length);
+            }
+            for (int cold = 0; cold <= 1; cold++)
+            {
+                measure("encode", encode, cold, size, zero_pcts[d], encoded_length);
+                measure("decode", decode, cold, size, zero_pcts[d], encoded_length);
+#ifdef BENCH_VALIDATION
+                measure("decode_trusted", decode_trusted, cold, size, zero_pcts[d], encoded_length);
+                measure("decode_deferred", decode_deferred, cold, size, zero_pcts[d], encoded_length);
+#endif
+#ifdef BENCH_CRC
+                for (size_t c = 0; c < sizeof(crc_ops) / sizeof(crc_ops[0]); c++)
+                {
+                    measure(crc_ops[c].op, crc_ops[c].codec, cold, size, zero_pcts[d], encoded_length);
+                }
+#endif
+#ifdef BENCH_DELIM
+                measure("encode_delim", encode_delim, cold, size, zero_pcts[d], encoded_length);
+                for (size_t k = 0; k < copies; k++)
+                {
+                    for (size_t i = 0; i < encoded_length; i++) encoded[k * stride + i] ^= BENCH_DELIM;
+                }
+                measure("decode_delim", decode_delim, cold, size, zero_pcts[d], encoded_length);
+                for (size_t k = 0; k < copies; k++)
+                {
+                    for (size_t i = 0; i < encoded_length; i++) encoded[k * stride + i] ^= BENCH_DELIM;
+                }
+#endif
+            }
+#ifdef BENCH_ZPE
+            encoded_length = cobs_zpe_encode(input, size, encoded);
+            for (size_t k = 1; k < copies; k++) memcpy(encoded + k * stride, encoded, encoded_length);
+            for (int cold = 0; cold <= 1; cold++)
+            {
+                measure("encode_zpe", cobs_zpe_encode, cold, size, zero_pcts[d], encoded_length);
+                measure("decode_zpe", cobs_zpe_decode, cold, size, zero_pcts[d], encoded_length);
+            }
+#endif
+        }
+    }
+#ifdef COBS_ENABLE_STATS
+    cobs_stats stats;
+    cobs_stats_read(&stats);
+    fprintf(stderr, "stats: %llu frames encoded, %llu decoded, overhead %.4f, %llu failures\n",
+            (unsigned long long)stats.frames_encoded, (unsigned long long)stats.frames_decoded,
+            cobs_stats_overhead(&stats), (unsigned long long)(stats.decode_failures[COBS_FAIL_ZERO_CODE] +
+            stats.decode_failures[COBS_FAIL_OVERRUN] + stats.decode_failures[COBS_FAIL_EMBEDDED_ZERO] +
+            stats.decode_failures[COBS_FAIL_CRC]));
+#endif
+    return 0;
+}
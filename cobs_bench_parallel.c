@@ -0,0 +1,166 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+
+// Throughput of the threaded paths against their serial counterparts, as CSV on stdout:
+//
+//     benchmark,threads,bytes,frames,seconds,MB_per_s,frames_per_s,speedup
+//
+// "encode" is cobs_encode_parallel on one large payload (threads 1 = plain cobs_encode); "decode" is a
+// captured stream of frames, split and decoded frame by frame with cobs_decode on one thread (threads 1),
+// or run through a cobs_pipeline with that many decoder threads. Speedup is against the threads 1 row.
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cobs.h"
+#include "cobs_parallel.h"
+
+#define ENCODE_BYTES (64u * 1024 * 1024)
+#define STREAM_BYTES (64u * 1024 * 1024)
+#define MAX_FRAME 1500
+#define REPEATS 3
+
+static const unsigned thread_counts[] = { 1, 2, 4, 8 };
+
+static uint32_t rand_state = 1;
+static uint8_t rand_byte(void)
+{
+    rand_state = rand_state * 1103515245u + 12345u;
+    return (uint8_t)(rand_state >> 16);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char * name, unsigned threads, size_t bytes, size_t frames, double seconds, double serial)
+{
+    printf("%s,%u,%lu,%lu,%.6f,%.1f,%.0f,%.2f\n", name, threads, (unsigned long)bytes, (unsigned long)frames,
+           seconds, bytes / seconds / 1e6, frames / seconds, serial / seconds);
+}
+
+static void bench_encode(void)
+{
+    uint8_t * input = malloc(ENCODE_BYTES);
+    uint8_t * output = malloc(ENCODE_BYTES + ENCODE_BYTES / 254 + 2);
+    if (input == NULL || output == NULL) exit(1);
+    for (size_t i = 0; i < ENCODE_BYTES; i++) input[i] = rand_byte() % 100 ? rand_byte() | 1 : 0;
+
+    double serial = 0;
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+    {
+        cobs_pool * pool = thread_counts[t] > 1 ? cobs_pool_create(thread_counts[t] - 1) : NULL;
+        double best = 1e9;
+        for (int r = 0; r < REPEATS; r++)
+        {
+            double start = now();
+            cobs_encode_parallel(pool, input, ENCODE_BYTES, output);
+            double seconds = now() - start;
+            if (seconds < best) best = seconds;
+        }
+        if (t == 0) serial = best;
+        report("encode", thread_counts[t], ENCODE_BYTES, 1, best, serial);
+        cobs_pool_destroy(pool);
+    }
+    free(input);
+    free(output);
+}
+
+typedef struct
+{
+    size_t frames;
+    size_t bytes;
+} decode_count;
+
+static void count_frame(void * context, cobs_status status, const uint8_t * frame, size_t length)
+{
+    decode_count * count = context;
+    (void)frame;
+    count->frames += status == COBS_OK;
+    count->bytes += length;
+}
+
+// the loop the pipeline replaces: find each terminator, decode what is in front of it
+static void serial_decode(const uint8_t * stream, size_t length, uint8_t * output, decode_count * count)
+{
+    const uint8_t * p = stream;
+    const uint8_t * end = stream + length;
+    while (p < end)
+    {
+        const uint8_t * t = memchr(p, COBS_TERMINATOR, (size_t)(end - p));
+        if (t == NULL) break;
+        if (t != p) count_frame(count, COBS_OK, output, cobs_decode(p, (size_t)(t - p), output));
+        p = t + 1;
+    }
+}
+
+static void bench_decode(void)
+{
+    uint8_t * stream = malloc(STREAM_BYTES + MAX_FRAME + 16);
+    uint8_t payload[MAX_FRAME];
+    uint8_t output[MAX_FRAME];
+    size_t length = 0, frames = 0;
+    if (stream == NULL) exit(1);
+    while (length < STREAM_BYTES)
+    {
+        size_t n = 64 + (rand_byte() << 8 | rand_byte()) % (MAX_FRAME - 64);
+        for (size_t i = 0; i < n; i++) payload[i] = rand_byte() % 50 ? rand_byte() : 0;
+        length += cobs_encode_frame(payload, n, stream + length, true);
+        frames++;
+    }
+
+    double serial = 0;
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+    {
+        double best = 1e9;
+        for (int r = 0; r < REPEATS; r++)
+        {
+            decode_count count = { 0, 0 };
+            double start = now();
+            if (thread_counts[t] == 1)
+            {
+                serial_decode(stream, length, output, &count);
+            }
+            else
+            {
+                cobs_pipeline * pipeline = cobs_pipeline_create(thread_counts[t], 256 * 1024, 4 * thread_counts[t],
+                                                                count_frame, &count);
+                if (pipeline == NULL) exit(1);
+                for (size_t pos = 0; pos < length; pos += 64 * 1024)   // as read() would hand it over
+                {
+                    cobs_pipeline_push(pipeline, stream + pos, length - pos < 64 * 1024 ? length - pos : 64 * 1024);
+                }
+                cobs_pipeline_destroy(pipeline);
+            }
+            double seconds = now() - start;
+            if (count.frames != frames)
+            {
+                fprintf(stderr, "decode: %lu frames of %lu\n", (unsigned long)count.frames, (unsigned long)frames);
+                exit(1);
+            }
+            if (seconds < best) best = seconds;
+        }
+        if (t == 0) serial = best;
+        report("decode", thread_counts[t], length, frames, best, serial);
+    }
+    free(stream);
+}
+
+int main(void)
+{
+    printf("benchmark,threads,bytes,frames,seconds,MB_per_s,frames_per_s,speedup\n");
+    bench_encode();
+    bench_decode();
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+
+// Frame buffers from the frame pool against a worst case malloc / free per frame, with 1 to 8 producer
+// threads each encoding frames of 16 B to 4 KB and releasing them again, as CSV on stdout:
+//
+//     allocator,threads,frames,seconds,ns_per_frame,frames_per_s
+//
+// "malloc" sizes each buffer for the worst case (COBS_ENCODE_MAX_LENGTH), and so do "pool" and "pool_nocache",
+// which take it from the pool with and without a per-thread cache in front of the shared free lists.
+// "pool_exact" uses cobs_frame_encode, paying for the cobs_encoded_length pre-pass to pick the smallest class.
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "cobs.h"
+#include "cobs_frame_pool.h"
+
+#define FRAMES_PER_THREAD 500000
+#define MAX_PAYLOAD 4096
+#define IN_FLIGHT 16                        // frames each producer holds before releasing the oldest
+
+enum { USE_MALLOC, USE_POOL, USE_POOL_NOCACHE, USE_POOL_EXACT };
+static const char * const names[] = { "malloc", "pool", "pool_nocache", "pool_exact" };
+static const unsigned thread_counts[] = { 1, 2, 4, 8 };
+
+static uint8_t payload[MAX_PAYLOAD];
+static cobs_frame_pool * pool;
+
+typedef struct
+{
+    int allocator;
+    unsigned seed;
+} producer;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void * produce(void * arg)
+{
+    producer * p = arg;
+    uint32_t state = p->seed;
+    uint8_t * held[IN_FLIGHT] = { NULL };
+    cobs_frame_cache storage;
+    cobs_frame_cache * cache = p->allocator == USE_POOL_NOCACHE ? NULL : &storage;
+    cobs_frame_cache_init(&storage);
+
+    for (unsigned i = 0; i < FRAMES_PER_THREAD; i++)
+    {
+        state = state * 1103515245u + 12345u;
+        size_t length = (size_t)16 << ((state >> 16) % 9);              // 16 B .. 4 KB
+        uint8_t ** slot = &held[i % IN_FLIGHT];
+        size_t encoded_length;
+        if (p->allocator == USE_MALLOC)
+        {
+            free(*slot);
+            *slot = malloc(COBS_ENCODE_MAX_LENGTH(length));
+            if (*slot) cobs_encode(payload, length, *slot);
+        }
+        else if (p->allocator == USE_POOL_EXACT)
+        {
+            cobs_frame_free(pool, cache, *slot);
+            *slot = cobs_frame_encode(pool, cache, payload, length, &encoded_length);
+        }
+        else
+        {
+            cobs_frame_free(pool, cache, *slot);
+            *slot = cobs_frame_alloc(pool, cache, COBS_ENCODE_MAX_LENGTH(length));
+            if (*slot) cobs_encode(payload, length, *slot);
+        }
+        if (*slot == NULL) abort();
+    }
+    for (size_t k = 0; k < IN_FLIGHT; k++)
+    {
+        if (p->allocator == USE_MALLOC) free(held[k]);
+        else cobs_frame_free(pool, cache, held[k]);
+    }
+    cobs_frame_cache_flush(pool, &storage);
+    return NULL;
+}
+
+int main(void)
+{
+    // enough buffers of each class for 8 producers' frames in flight plus their caches
+    size_t counts[COBS_FRAME_CLASSES];
+    for (int c = 0; c < COBS_FRAME_CLASSES; c++) counts[c] = 8 * (IN_FLIGHT + COBS_FRAME_CACHE_SIZE);
+    pool = cobs_frame_pool_create(counts);
+    if (pool == NULL) return 1;
+    for (size_t i = 0; i < MAX_PAYLOAD; i++) payload[i] = (uint8_t)(i % 97 ? i : 0);
+
+    printf("allocator,threads,frames,seconds,ns_per_frame,frames_per_s\n");
+    for (int a = USE_MALLOC; a <= USE_POOL_EXACT; a++)
+    {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+        {
+            pthread_t threads[8];
+            producer producers[8];
+            unsigned n = thread_counts[t];
+            double start = now();
+            for (unsigned i = 0; i < n; i++)
+            {
+                producers[i] = (producer){ a, i + 1 };
+                pthread_create(&threads[i], NULL, produce, &producers[i]);
+            }
+            for (unsigned i = 0; i < n; i++) pthread_join(threads[i], NULL);
+            double seconds = now() - start;
+            double frames = (double)n * FRAMES_PER_THREAD;
+            printf("%s,%u,%.0f,%.6f,%.1f,%.0f\n", names[a], n, frames, seconds, seconds * 1e9 / frames, frames / seconds);
+        }
+    }
+    cobs_frame_pool_destroy(pool);
+    return 0;
+}
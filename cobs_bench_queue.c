@@ -0,0 +1,170 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+
+// Hand-off of encoded frames from a reader thread to a decoder thread: cobs_queue against the usual bounded
+// buffer with a mutex and two condition variables, as CSV on stdout:
+//
+//     queue,mode,frames,seconds,ns_per_frame,frames_per_s,p50_latency_ns,p99_latency_ns
+//
+// The producer encodes 16 to 256 byte frames, each carrying the time it was sent, straight into the queue
+// (cobs_queue) or into a scratch buffer copied into a slot under the lock (mutex); the consumer decodes them
+// in place and notes how long each one took to arrive. "stream" sends as fast as the consumer takes them,
+// "pingpong" sends the next frame only once the last one is decoded, which gives the bare hand-off latency.
+// An empty or full cobs_queue is waited on with sched_yield.
+#define _POSIX_C_SOURCE 199309L
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "cobs.h"
+#include "cobs_queue.h"
+
+#define FRAMES 200000
+#define SLOTS 64
+#define SLOT_BYTES COBS_ENCODE_MAX_LENGTH(256)
+
+enum { USE_QUEUE, USE_MUTEX };
+static const char * const names[] = { "cobs_queue", "mutex" };
+static const char * const modes[] = { "stream", "pingpong" };
+
+static cobs_queue * queue;
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+    uint8_t slots[SLOTS][SLOT_BYTES];
+    size_t lengths[SLOTS];
+    size_t head, tail;
+} locked = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, { { 0 } }, { 0 }, 0, 0 };
+
+static uint64_t latencies[FRAMES];
+static uint32_t consumed;                   // frames the consumer is done with
+
+typedef struct
+{
+    int use;
+    bool pingpong;
+} run_config;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void * produce(void * arg)
+{
+    run_config * config = arg;
+    uint8_t payload[256];
+    uint8_t scratch[SLOT_BYTES];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)(i % 37 ? i : 0);
+
+    for (uint32_t n = 0; n < FRAMES; n++)
+    {
+        size_t length = 16 + (n * 2654435761u >> 24);                      // 16 .. 271, capped below
+        if (length > sizeof(payload)) length = sizeof(payload);
+        if (config->pingpong)
+        {
+            while (__atomic_load_n(&consumed, __ATOMIC_ACQUIRE) != n) sched_yield();
+        }
+        uint64_t sent = now_ns();
+        memcpy(payload, &sent, sizeof(sent));
+        if (config->use == USE_QUEUE)
+        {
+            uint8_t * slot;
+            while ((slot = cobs_queue_reserve(queue, COBS_ENCODE_MAX_LENGTH(length))) == NULL) sched_yield();
+            cobs_queue_commit(queue, cobs_encode_frame(payload, length, slot, false));
+        }
+        else
+        {
+            size_t encoded = cobs_encode_frame(payload, length, scratch, false);
+            pthread_mutex_lock(&locked.lock);
+            while (locked.tail - locked.head == SLOTS) pthread_cond_wait(&locked.not_full, &locked.lock);
+            memcpy(locked.slots[locked.tail % SLOTS], scratch, encoded);
+            locked.lengths[locked.tail % SLOTS] = encoded;
+            locked.tail++;
+            pthread_cond_signal(&locked.not_empty);
+            pthread_mutex_unlock(&locked.lock);
+        }
+    }
+    return NULL;
+}
+
+static void consume(int use)
+{
+    uint8_t frame[SLOT_BYTES];
+    for (uint32_t n = 0; n < FRAMES; n++)
+    {
+        uint64_t sent;
+        if (use == USE_QUEUE)
+        {
+            size_t length;
+            uint8_t * slot;
+            while ((slot = cobs_queue_peek(queue, &length)) == NULL) sched_yield();
+            cobs_decode_inplace(slot, length);
+            memcpy(&sent, slot, sizeof(sent));
+            cobs_queue_release(queue);
+        }
+        else
+        {
+            pthread_mutex_lock(&locked.lock);
+            while (locked.tail == locked.head) pthread_cond_wait(&locked.not_empty, &locked.lock);
+            size_t length = locked.lengths[locked.head % SLOTS];
+            memcpy(frame, locked.slots[locked.head % SLOTS], length);
+            locked.head++;
+            pthread_cond_signal(&locked.not_full);
+            pthread_mutex_unlock(&locked.lock);
+            cobs_decode_inplace(frame, length);
+            memcpy(&sent, frame, sizeof(sent));
+        }
+        latencies[n] = now_ns() - sent;
+        __atomic_store_n(&consumed, n + 1, __ATOMIC_RELEASE);
+    }
+}
+
+static int compare(const void * a, const void * b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(void)
+{
+    queue = cobs_queue_create(SLOTS * SLOT_BYTES);
+    if (queue == NULL) return 1;
+
+    printf("queue,mode,frames,seconds,ns_per_frame,frames_per_s,p50_latency_ns,p99_latency_ns\n");
+    for (int pingpong = 0; pingpong <= 1; pingpong++)
+    {
+        for (int use = USE_QUEUE; use <= USE_MUTEX; use++)
+        {
+            run_config config = { use, pingpong };
+            pthread_t producer;
+            consumed = 0;
+            uint64_t start = now_ns();
+            pthread_create(&producer, NULL, produce, &config);
+            consume(use);
+            pthread_join(producer, NULL);
+            double seconds = (now_ns() - start) * 1e-9;
+            qsort(latencies, FRAMES, sizeof(latencies[0]), compare);
+            printf("%s,%s,%u,%.6f,%.1f,%.0f,%lu,%lu\n", names[use], modes[pingpong], FRAMES, seconds,
+                   seconds * 1e9 / FRAMES, FRAMES / seconds, (unsigned long)latencies[FRAMES / 2],
+                   (unsigned long)latencies[FRAMES / 100 * 99]);
+            fflush(stdout);
+        }
+    }
+    cobs_queue_destroy(queue);
+    return 0;
+}
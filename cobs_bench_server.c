@@ -0,0 +1,187 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+
+// Receiving frames from many ports: one cobs_server thread against a thread per port blocked in read() and
+// feeding its own cobs_receiver, for a growing number of ptys standing in for serial lines, as CSV on stdout:
+//
+//     server,ports,frames,seconds,frames_per_s,p50_latency_ns,p99_latency_ns,context_switches
+//
+// A writer thread sends 64 byte frames, each carrying the time it was sent, round robin to the master side of
+// every pty, as fast as the ptys take them; the receiving side decodes them off the slave sides and notes how
+// long each one took to arrive, which includes any time it spent queued in the pty. context_switches counts
+// the voluntary and involuntary switches of the whole process during the run.
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "cobs.h"
+#include "cobs_server.h"
+
+#define FRAMES 100000
+#define PAYLOAD 64
+#define MAX_PORTS 64
+
+enum { USE_SERVER, USE_THREADS };
+static const char * const names[] = { "cobs_server", "threads" };
+
+static int masters[MAX_PORTS], slaves[MAX_PORTS];
+static int ports;
+static uint64_t latencies[FRAMES];
+static uint32_t received;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static bool open_pty(int * master, int * slave)
+{
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*master < 0 || grantpt(*master) || unlockpt(*master)) return false;
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY);
+    struct termios raw;
+    if (*slave < 0 || tcgetattr(*slave, &raw)) return false;
+    cfmakeraw(&raw);
+    return tcsetattr(*slave, TCSANOW, &raw) == 0;
+}
+
+static void * send_frames(void * arg)
+{
+    (void)arg;
+    uint8_t payload[PAYLOAD];
+    uint8_t encoded[COBS_ENCODE_MAX_LENGTH(PAYLOAD) + 1];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)(i % 11 ? i : 0);
+    for (uint32_t n = 0; n < FRAMES; n++)
+    {
+        uint64_t sent = now_ns();
+        memcpy(payload, &sent, sizeof(sent));
+        size_t length = cobs_encode_frame(payload, sizeof(payload), encoded, true);
+        const uint8_t * p = encoded;
+        while (length > 0)
+        {
+            ssize_t written = write(masters[n % ports], p, length);
+            if (written <= 0) return NULL;
+            p += written;
+            length -= (size_t)written;
+        }
+    }
+    return NULL;
+}
+
+// context, when not NULL, counts the frames of one port
+static void note_frame(void * context, cobs_status status, const uint8_t * frame, size_t length)
+{
+    uint64_t sent;
+    if (status != COBS_OK || length < sizeof(sent)) return;
+    memcpy(&sent, frame, sizeof(sent));
+    latencies[__atomic_fetch_add(&received, 1, __ATOMIC_RELAXED)] = now_ns() - sent;
+    if (context) (*(uint32_t *)context)++;
+}
+
+static void note_port_frame(void * context, int port, cobs_status status, const uint8_t * frame, size_t length)
+{
+    (void)port;
+    note_frame(context, status, frame, length);
+}
+
+// one thread per port: block in read(), decode what came
+static void * receive_port(void * arg)
+{
+    int port = (int)(intptr_t)arg;
+    uint32_t due = FRAMES / ports + (port < FRAMES % ports), done = 0;
+    uint8_t input[65536];
+    uint8_t frame[PAYLOAD];
+    cobs_receiver rx;
+    cobs_receiver_init(&rx, frame, sizeof(frame));
+    while (done < due)
+    {
+        ssize_t n = read(slaves[port], input, sizeof(input));
+        if (n <= 0) break;
+        cobs_receiver_process(&rx, input, (size_t)n, note_frame, &done);
+    }
+    return NULL;
+}
+
+static int compare(const void * a, const void * b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static long context_switches(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+int main(void)
+{
+    for (int p = 0; p < MAX_PORTS; p++)
+    {
+        if (!open_pty(&masters[p], &slaves[p]))
+        {
+            fprintf(stderr, "cannot open pty %d\n", p);
+            return 1;
+        }
+    }
+
+    printf("server,ports,frames,seconds,frames_per_s,p50_latency_ns,p99_latency_ns,context_switches\n");
+    for (ports = 1; ports <= MAX_PORTS; ports *= 2)
+    {
+        for (int use = USE_SERVER; use <= USE_THREADS; use++)
+        {
+            cobs_server * server = NULL;
+            pthread_t receivers[MAX_PORTS];
+            if (use == USE_SERVER)
+            {
+                server = cobs_server_create(PAYLOAD, note_port_frame, NULL);
+                for (int p = 0; p < ports; p++) cobs_server_add(server, slaves[p]);
+            }
+            received = 0;
+            long switches = context_switches();
+            uint64_t start = now_ns();
+            pthread_t writer;
+            pthread_create(&writer, NULL, send_frames, NULL);
+            if (use == USE_SERVER)
+            {
+                while (__atomic_load_n(&received, __ATOMIC_RELAXED) < FRAMES) cobs_server_poll(server, 100);
+            }
+            else
+            {
+                for (int p = 0; p < ports; p++) pthread_create(&receivers[p], NULL, receive_port, (void *)(intptr_t)p);
+                for (int p = 0; p < ports; p++) pthread_join(receivers[p], NULL);
+            }
+            pthread_join(writer, NULL);
+            double seconds = (now_ns() - start) * 1e-9;
+            switches = context_switches() - switches;
+            if (server)
+            {
+                cobs_server_destroy(server);
+                // the server left the slaves non-blocking; the per port threads want to block
+                for (int p = 0; p < ports; p++) fcntl(slaves[p], F_SETFL, fcntl(slaves[p], F_GETFL) & ~O_NONBLOCK);
+            }
+            qsort(latencies, FRAMES, sizeof(latencies[0]), compare);
+            printf("%s,%d,%u,%.6f,%.0f,%lu,%lu,%ld\n", names[use], ports, FRAMES, seconds, FRAMES / seconds,
+                   (unsigned long)latencies[FRAMES / 2], (unsigned long)latencies[FRAMES / 100 * 99], switches);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,367 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+
+// cobs - COBS encode or decode files and pipes at memory speed.
+//
+//     cobs encode [-b bytes] [input [output]]   the whole input as one frame, or cut into frames of -b bytes,
+//                                               each followed by a terminator
+//     cobs decode [input [output]]              a stream of terminated frames, payloads written back to back
+//     cobs split  [input [output]]              the same, each payload written as a record: a 4 byte little
+//                                               endian length, then the payload
+//
+// Input and output default to stdin and stdout ("-" for either says the same). A regular input file is mapped
+// rather than read, and is handled WINDOW bytes at a time by the library's batch paths (cobs_encode_frame,
+// cobs_encoder_update, cobs_decode_batch) into an output arena, which goes out in one writev per window. When
+// the output is a pipe it is vmspliced instead, so the pipe takes the arena's pages rather than a copy of them;
+// each window then gets a fresh arena, and it is unmapped, never written again, once it is in the pipe. Bad
+// frames are dropped and counted. Throughput is reported on stderr at exit.
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "cobs.h"
+
+#define WINDOW ((size_t)4 * 1024 * 1024)   // input bytes per batch
+#define BATCH_FRAMES 65536                  // frame descriptors per cobs_decode_batch call
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+enum { ENCODE, DECODE, SPLIT };
+
+// the input: a mapping of the whole file, or a buffer refilled with read() for anything that cannot be mapped
+typedef struct
+{
+    int fd;
+    const uint8_t * map;
+    size_t map_length;
+    size_t pos;                             // start of the unused input, in the mapping
+    uint8_t * buffer;
+    size_t capacity;
+    size_t length;                          // bytes in buffer
+    bool eof;
+} source;
+
+// the output, with the iovecs of the current window
+typedef struct
+{
+    int fd;
+    bool pipe;
+    struct iovec iov[IOV_MAX];
+    int count;
+    uint8_t * arena;
+    size_t arena_size;
+} sink;
+
+static struct
+{
+    uint64_t bytes_in, bytes_out, frames, errors;
+} stats;
+
+static int fail(const char * what)
+{
+    fprintf(stderr, "cobs: %s: %s\n", what, strerror(errno));
+    return 1;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool source_open(source * in, int fd)
+{
+    struct stat st;
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void * map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            in->map = map;
+            in->map_length = (size_t)st.st_size;
+            return true;
+        }
+    }
+    in->capacity = WINDOW;
+    in->buffer = malloc(in->capacity);
+    return in->buffer != NULL;
+}
+
+// at least want bytes of input (fewer only at the end of it) at *data; *last is set once there is no more
+static bool source_window(source * in, size_t want, const uint8_t ** data, size_t * length, bool * last)
+{
+    if (in->map)
+    {
+        size_t left = in->map_length - in->pos;
+        *data = in->map + in->pos;
+        *length = left < want ? left : want;
+        *last = *length == left;
+        return true;
+    }
+    if (want > in->capacity)
+    {
+        uint8_t * bigger = realloc(in->buffer, want);
+        if (bigger == NULL) return false;
+        in->buffer = bigger;
+        in->capacity = want;
+    }
+    while (in->length < want && !in->eof)
+    {
+        ssize_t n = read(in->fd, in->buffer + in->length, want - in->length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) in->eof = true;
+        in->length += (size_t)n;
+    }
+    *data = in->buffer;
+    *length = in->length < want ? in->length : want;
+    *last = in->eof && *length == in->length;
+    return true;
+}
+
+static void source_consume(source * in, size_t used)
+{
+    stats.bytes_in += used;
+    if (in->map)
+    {
+        in->pos += used;
+        return;
+    }
+    memmove(in->buffer, in->buffer + used, in->length - used);
+    in->length -= used;
+}
+
+// an arena of at least size bytes for this window's output. A pipe gets a fresh one every time (see above).
+// An empty window still gets one byte, as neither mmap nor malloc can be counted on for 0.
+static uint8_t * sink_arena(sink * out, size_t size)
+{
+    if (size == 0) size = 1;
+    if (out->arena && (out->pipe || out->arena_size < size))
+    {
+        if (out->pipe) munmap(out->arena, out->arena_size);
+        else free(out->arena);
+        out->arena = NULL;
+    }
+    if (out->arena == NULL)
+    {
+        out->arena_size = size;
+        if (out->pipe)
+        {
+            out->arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (out->arena == MAP_FAILED) out->arena = NULL;
+        }
+        else
+        {
+            out->arena = malloc(size);
+        }
+    }
+    return out->arena;
+}
+
+// send the queued iovecs, carrying on after partial writes
+static bool sink_flush(sink * out)
+{
+    struct iovec * iov = out->iov;
+    int count = out->count;
+    while (count > 0)
+    {
+        ssize_t n = out->pipe ? vmsplice(out->fd, iov, (unsigned long)count, 0) : writev(out->fd, iov, count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        stats.bytes_out += (size_t)n;
+        while (count > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    out->count = 0;
+    return true;
+}
+
+static bool sink_add(sink * out, const void * data, size_t length)
+{
+    if (length == 0) return true;
+    if (out->count == IOV_MAX && !sink_flush(out)) return false;
+    out->iov[out->count++] = (struct iovec){ (void *)data, length };
+    return true;
+}
+
+static bool encode(source * in, sink * out, size_t frame_bytes)
+{
+    cobs_encoder enc;
+    cobs_encoder_init(&enc);
+    size_t want = frame_bytes && frame_bytes > WINDOW ? frame_bytes : (frame_bytes ? WINDOW / frame_bytes * frame_bytes : WINDOW);
+    for (;;)
+    {
+        const uint8_t * data;
+        size_t length;
+        bool last;
+        if (!source_window(in, want, &data, &length, &last)) return false;
+        size_t frames = frame_bytes ? (length + frame_bytes - 1) / frame_bytes : 0;
+        uint8_t * arena = sink_arena(out, frame_bytes ? frames * COBS_ENCODE_MAX_LENGTH(frame_bytes)
+                                                      : COBS_ENCODER_UPDATE_BOUND(length) + 256);
+        if (arena == NULL) return false;
+        size_t written = 0;
+        if (frame_bytes)
+        {
+            for (size_t f = 0; f < frames; f++)
+            {
+                size_t piece = length - f * frame_bytes < frame_bytes ? length - f * frame_bytes : frame_bytes;
+                written += cobs_encode_frame(data + f * frame_bytes, piece, arena + written, true);
+            }
+            stats.frames += frames;
+        }
+        else
+        {
+            written = cobs_encoder_update(&enc, data, length, arena);
+            if (last)
+            {
+                written += cobs_encoder_finish(&enc, arena + written, true);
+                stats.frames++;
+            }
+        }
+        source_consume(in, length);
+        if (!sink_add(out, arena, written) || !sink_flush(out)) return false;
+        if (last) return true;
+    }
+}
+
+// Frames are decoded a window at a time; whatever is left of an unfinished frame at the end of a window
+// starts the next one. If a window holds no whole frame at all, it is doubled until it does.
+static bool decode(source * in, sink * out, bool split)
+{
+    static cobs_frame frames[BATCH_FRAMES];
+    size_t want = WINDOW;
+    for (;;)
+    {
+        const uint8_t * data;
+        size_t length;
+        bool last;
+        if (!source_window(in, want, &data, &length, &last)) return false;
+        size_t headers = split ? 4 * (size_t)BATCH_FRAMES + 4 : 0;
+        uint8_t * arena = sink_arena(out, length + headers + 1);
+        if (arena == NULL) return false;
+        uint8_t * header = arena + length + 1;
+
+        size_t trailing;
+        size_t count = cobs_decode_batch(data, length, arena, frames, BATCH_FRAMES, &trailing);
+        if (last && trailing && count < BATCH_FRAMES)       // an unterminated last frame
+        {
+            size_t decoded = cobs_decode(data + length - trailing, trailing, arena + length - trailing);
+            bool empty = trailing == 1 && data[length - 1] == 0x01;    // valid, but decodes to 0 bytes as well
+            frames[count++] = (cobs_frame){ length - trailing, decoded, decoded || empty ? COBS_OK : COBS_ERR_OVERRUN };
+            trailing = 0;
+        }
+        for (size_t f = 0; f < count; f++)
+        {
+            if (frames[f].status != COBS_OK)
+            {
+                stats.errors++;
+                continue;
+            }
+            stats.frames++;
+            if (split)
+            {
+                uint32_t n = (uint32_t)frames[f].length;
+                uint8_t * h = header + 4 * f;
+                h[0] = (uint8_t)n;
+                h[1] = (uint8_t)(n >> 8);
+                h[2] = (uint8_t)(n >> 16);
+                h[3] = (uint8_t)(n >> 24);
+                if (!sink_add(out, h, 4)) return false;
+            }
+            if (!sink_add(out, arena + frames[f].offset, frames[f].length)) return false;
+        }
+        if (!sink_flush(out)) return false;
+        source_consume(in, length - trailing);
+        if (last && trailing == 0) return true;
+        want = count == 0 ? 2 * want : WINDOW;
+    }
+}
+
+static int usage(void)
+{
+    fprintf(stderr, "usage: cobs encode [-b bytes] [input [output]]\n"
+                    "       cobs decode [input [output]]\n"
+                    "       cobs split  [input [output]]\n");
+    return 2;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2) return usage();
+    int mode;
+    if (strcmp(argv[1], "encode") == 0) mode = ENCODE;
+    else if (strcmp(argv[1], "decode") == 0) mode = DECODE;
+    else if (strcmp(argv[1], "split") == 0) mode = SPLIT;
+    else return usage();
+
+    int arg = 2;
+    size_t frame_bytes = 0;
+    if (mode == ENCODE && arg + 1 < argc && strcmp(argv[arg], "-b") == 0)
+    {
+        char * end;
+        frame_bytes = strtoull(argv[arg + 1], &end, 0);
+        if (*end || frame_bytes == 0) return usage();
+        arg += 2;
+    }
+    if (argc - arg > 2) return usage();
+
+    int in_fd = STDIN_FILENO, out_fd = STDOUT_FILENO;
+    if (arg < argc && strcmp(argv[arg], "-") != 0)
+    {
+        in_fd = open(argv[arg], O_RDONLY);
+        if (in_fd < 0) return fail(argv[arg]);
+    }
+    if (arg + 1 < argc && strcmp(argv[arg + 1], "-") != 0)
+    {
+        out_fd = open(argv[arg + 1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out_fd < 0) return fail(argv[arg + 1]);
+    }
+
+    static source in;
+    static sink out;
+    struct stat st;
+    if (!source_open(&in, in_fd)) return fail("input");
+    out.fd = out_fd;
+    out.pipe = fstat(out_fd, &st) == 0 && S_ISFIFO(st.st_mode);
+
+    double start = now();
+    bool ok = mode == ENCODE ? encode(&in, &out, frame_bytes) : decode(&in, &out, mode == SPLIT);
+    double seconds = now() - start;
+    if (!ok) return fail("output");
+
+    if (seconds <= 0) seconds = 1e-9;
+    fprintf(stderr, "cobs %s: %llu bytes in, %llu bytes out, %llu frames, %llu bad, %.3f s, %.1f MB/s, %.0f frames/s\n",
+            argv[1], (unsigned long long)stats.bytes_in, (unsigned long long)stats.bytes_out,
+            (unsigned long long)stats.frames, (unsigned long long)stats.errors, seconds,
+            stats.bytes_in / seconds / 1e6, stats.frames / seconds);
+    return 0;
+}
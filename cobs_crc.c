@@ -0,0 +1,127 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#include "cobs_crc.h"
+#include "cobs.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef COBS_MAX_SIMD
+#define COBS_MAX_SIMD 2
+#endif
+
+#if COBS_MAX_SIMD > 0 && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COBS_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define COBS_X86_SIMD 0
+#endif
+
+#define CRC16_POLY 0x1021
+#define CRC32C_POLY 0x82F63B78u             // reflected
+
+// Slice-by-8 tables: t[k][b] is the CRC contribution of byte b followed by k zero bytes, so 8 bytes are
+// folded in with 8 independent lookups. Built once before main, so no thread ever sees them half done.
+static uint16_t crc16_table[8][256];
+static uint32_t crc32c_table[8][256];
+
+static uint32_t crc32c_slice8(uint32_t crc, const uint8_t * data, size_t length);
+static uint32_t (*crc32c_fn)(uint32_t, const uint8_t *, size_t) = crc32c_slice8;
+
+#if COBS_X86_SIMD
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t * data, size_t length)
+{
+    const uint8_t * end = data + length;
+#ifdef __x86_64__
+    uint64_t c = ~crc;
+    for (; end - data >= 8; data += 8)
+    {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+#else
+    crc = ~crc;
+    for (; end - data >= 4; data += 4)
+    {
+        uint32_t v;
+        memcpy(&v, data, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+#endif
+    while (data < end) crc = _mm_crc32_u8(crc, *data++);
+    return ~crc;
+}
+#endif
+
+__attribute__((constructor))
+static void make_tables(void)
+{
+    for (unsigned b = 0; b < 256; b++)
+    {
+        uint16_t c16 = (uint16_t)(b << 8);
+        uint32_t c32 = b;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            c16 = (uint16_t)(c16 & 0x8000 ? (c16 << 1) ^ CRC16_POLY : c16 << 1);
+            c32 = c32 & 1 ? (c32 >> 1) ^ CRC32C_POLY : c32 >> 1;
+        }
+        crc16_table[0][b] = c16;
+        crc32c_table[0][b] = c32;
+    }
+    for (int k = 1; k < 8; k++)
+    {
+        for (unsigned b = 0; b < 256; b++)
+        {
+            uint16_t c16 = crc16_table[k - 1][b];
+            uint32_t c32 = crc32c_table[k - 1][b];
+            crc16_table[k][b] = (uint16_t)(c16 << 8) ^ crc16_table[0][c16 >> 8];
+            crc32c_table[k][b] = (c32 >> 8) ^ crc32c_table[0][c32 & 0xFF];
+        }
+    }
+#if COBS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) crc32c_fn = crc32c_sse42;
+#endif
+}
+
+uint16_t cobs_crc16_ccitt(uint16_t crc, const uint8_t * data, size_t length)
+{
+    const uint8_t * end = data + length;
+    for (; end - data >= 8; data += 8)
+    {
+        crc = crc16_table[7][data[0] ^ (crc >> 8)] ^ crc16_table[6][data[1] ^ (crc & 0xFF)] ^
+              crc16_table[5][data[2]] ^ crc16_table[4][data[3]] ^ crc16_table[3][data[4]] ^
+              crc16_table[2][data[5]] ^ crc16_table[1][data[6]] ^ crc16_table[0][data[7]];
+    }
+    while (data < end) crc = (uint16_t)(crc << 8) ^ crc16_table[0][(crc >> 8) ^ *data++];
+    return crc;
+}
+
+static uint32_t crc32c_slice8(uint32_t crc, const uint8_t * data, size_t length)
+{
+    const uint8_t * end = data + length;
+    crc = ~crc;
+    for (; end - data >= 8; data += 8)
+    {
+        uint32_t lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][data[4]] ^ crc32c_table[2][data[5]] ^
+              crc32c_table[1][data[6]] ^ crc32c_table[0][data[7]];
+    }
+    while (data < end) crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data++) & 0xFF];
+    return ~crc;
+}
+
+uint32_t cobs_crc32c(uint32_t crc, const uint8_t * data, size_t length)
+{
+    return crc32c_fn(crc, data, length);
+}
@@ -0,0 +1,53 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_CRC_H
+#define COBS_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "cobs.h"
+
+// CRC computed on the way through the encoder and decoder, so a checked frame costs one pass over the data
+// each way instead of two. Two CRCs are offered:
+//   COBS_CRC16_CCITT  poly 0x1021, init 0xFFFF, not reflected, no final XOR ("CCITT-FALSE", check 0x29B1),
+//                     appended high byte first
+//   COBS_CRC32C       Castagnoli, poly 0x1EDC6F41 reflected, init and final XOR 0xFFFFFFFF (check 0xE3069283),
+//                     appended low byte first. On x86 with SSE4.2 this uses the crc32 instruction.
+// Both are computed 8 bytes at a time (slice-by-8) where there is no instruction for it.
+typedef enum
+{
+    COBS_CRC16_CCITT,
+    COBS_CRC32C,
+} cobs_crc_kind;
+
+// bytes the CRC takes when appended to the payload
+#define COBS_CRC_SIZE(kind) ((kind) == COBS_CRC32C ? 4 : 2)
+
+// CRC of length bytes, carried on from crc: start with COBS_CRC16_INIT, or with 0 for CRC-32C (whose running
+// value is kept finished, so that cobs_crc32c(cobs_crc32c(0, a), b) is the CRC of a followed by b).
+#define COBS_CRC16_INIT 0xFFFF
+uint16_t cobs_crc16_ccitt(uint16_t crc, const uint8_t * data, size_t length);
+uint32_t cobs_crc32c(uint32_t crc, const uint8_t * data, size_t length);
+
+// ENCODE as cobs_encode_frame, with the CRC of the payload computed as the blocks are copied. If append is true
+// the CRC is put after the payload and encoded with it, so output needs room for
+// COBS_ENCODE_MAX_LENGTH(length + COBS_CRC_SIZE(kind)) bytes. If crc is not NULL it is set to the CRC.
+size_t cobs_encode_crc(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                       cobs_crc_kind kind, bool append, bool terminate, uint32_t * crc);
+
+// DECODE as cobs_decode, with the CRC computed over the decoded bytes as they are written. If verify is true the
+// frame is taken to end with the CRC of the rest, as cobs_encode_crc appends it: it is checked and left out of
+// *decoded_length. If crc is not NULL it is set to the CRC computed (of the payload without its CRC when
+// verifying). Returns
+//   COBS_OK          - the frame is valid, output[0 .. *decoded_length) is the payload
+//   COBS_ERR_OVERRUN - the frame is invalid, as when cobs_decode returns 0 (*decoded_length is 0)
+//   COBS_ERR_CRC     - the frame is valid, but shorter than a CRC or its CRC does not match
+cobs_status cobs_decode_crc(const uint8_t * restrict input, size_t length, uint8_t * restrict output,
+                            cobs_crc_kind kind, bool verify, size_t * decoded_length, uint32_t * crc);
+
+#endif
@@ -0,0 +1,207 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#include "cobs_frame_pool.h"
+#include "cobs.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// buffers are rounded up to whole cache lines, so that two threads never share one
+#define LINE 64
+
+// Each class is one contiguous run of buffers, and its free list is a stack threaded through next[]. The
+// head packs the top of the stack (index + 1, 0 when empty) in its low half with a counter bumped on
+// every change in the high half, so a pop that raced with a pop and a push of the same buffer (ABA)
+// fails its compare-and-swap instead of corrupting the list.
+typedef struct
+{
+    uint8_t * base;
+    size_t size;                            // bytes per buffer
+    size_t count;
+    uint32_t * next;                        // next[i]: the buffer under buffer i on the stack, plus one
+    uint64_t head;
+} frame_class;
+
+struct cobs_frame_pool
+{
+    frame_class classes[COBS_FRAME_CLASSES];
+    uint8_t * memory;
+    uint32_t * links;
+};
+
+static uint32_t pop(frame_class * c)
+{
+    uint64_t head = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE);
+    uint64_t replacement;
+    do
+    {
+        uint32_t top = (uint32_t)head;
+        if (top == 0) return 0;
+        uint32_t next = __atomic_load_n(&c->next[top - 1], __ATOMIC_RELAXED); // may be stale; the CAS then fails
+        replacement = ((head >> 32) + 1) << 32 | next;
+    } while (!__atomic_compare_exchange_n(&c->head, &head, replacement, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    return (uint32_t)head;
+}
+
+static void push(frame_class * c, uint32_t item)
+{
+    uint64_t head = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+    uint64_t replacement;
+    do
+    {
+        __atomic_store_n(&c->next[item - 1], (uint32_t)head, __ATOMIC_RELAXED);
+        replacement = ((head >> 32) + 1) << 32 | item;
+    } while (!__atomic_compare_exchange_n(&c->head, &head, replacement, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static size_t class_size(int c)
+{
+    return (COBS_ENCODE_MAX_LENGTH(COBS_FRAME_CLASS_PAYLOAD(c)) + LINE - 1) / LINE * LINE;
+}
+
+cobs_frame_pool * cobs_frame_pool_create(const size_t counts[COBS_FRAME_CLASSES])
+{
+    size_t bytes = 0, links = 0;
+    for (int c = 0; c < COBS_FRAME_CLASSES; c++)
+    {
+        if (counts[c] >= UINT32_MAX) return NULL;
+        bytes += class_size(c) * counts[c];
+        links += counts[c];
+    }
+
+    cobs_frame_pool * pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) return NULL;
+    pool->memory = malloc(bytes + LINE);
+    pool->links = malloc(sizeof(uint32_t) * (links ? links : 1));
+    if (pool->memory == NULL || pool->links == NULL)
+    {
+        cobs_frame_pool_destroy(pool);
+        return NULL;
+    }
+
+    uint8_t * base = (uint8_t *)(((uintptr_t)pool->memory + LINE - 1) & ~(uintptr_t)(LINE - 1));
+    uint32_t * next = pool->links;
+    for (int c = 0; c < COBS_FRAME_CLASSES; c++)
+    {
+        frame_class * fc = &pool->classes[c];
+        fc->base = base;
+        fc->size = class_size(c);
+        fc->count = counts[c];
+        fc->next = next;
+        for (size_t i = 0; i < fc->count; i++) next[i] = i + 1 < fc->count ? (uint32_t)(i + 2) : 0;
+        fc->head = fc->count ? 1 : 0;                                       // buffer 0 on top
+        base += fc->size * fc->count;
+        next += fc->count;
+    }
+    return pool;
+}
+
+void cobs_frame_pool_destroy(cobs_frame_pool * pool)
+{
+    if (pool == NULL) return;
+    free(pool->memory);
+    free(pool->links);
+    free(pool);
+}
+
+void cobs_frame_cache_init(cobs_frame_cache * cache)
+{
+    memset(cache->count, 0, sizeof(cache->count));
+}
+
+void cobs_frame_cache_flush(cobs_frame_pool * pool, cobs_frame_cache * cache)
+{
+    for (int c = 0; c < COBS_FRAME_CLASSES; c++)
+    {
+        while (cache->count[c]) push(&pool->classes[c], cache->index[c][--cache->count[c]]);
+    }
+}
+
+// a free buffer of class c (index + 1), or 0
+static uint32_t take(cobs_frame_pool * pool, cobs_frame_cache * cache, int c)
+{
+    if (cache == NULL) return pop(&pool->classes[c]);
+    if (cache->count[c] == 0)
+    {
+        while (cache->count[c] < COBS_FRAME_CACHE_SIZE / 2)                 // refill half the cache
+        {
+            uint32_t item = pop(&pool->classes[c]);
+            if (item == 0) break;
+            cache->index[c][cache->count[c]++] = item;
+        }
+        if (cache->count[c] == 0) return 0;
+    }
+    return cache->index[c][--cache->count[c]];
+}
+
+uint8_t * cobs_frame_alloc(cobs_frame_pool * pool, cobs_frame_cache * cache, size_t bytes)
+{
+    for (int c = 0; c < COBS_FRAME_CLASSES; c++)
+    {
+        frame_class * fc = &pool->classes[c];
+        if (fc->size < bytes) continue;
+        uint32_t item = take(pool, cache, c);
+        if (item) return fc->base + (item - 1) * fc->size;
+    }
+    return NULL;
+}
+
+static int class_of(const cobs_frame_pool * pool, const uint8_t * buffer)
+{
+    int c = COBS_FRAME_CLASSES - 1;
+    while (c > 0 && buffer < pool->classes[c].base) c--;
+    return c;
+}
+
+void cobs_frame_free(cobs_frame_pool * pool, cobs_frame_cache * cache, uint8_t * buffer)
+{
+    if (buffer == NULL) return;
+    int c = class_of(pool, buffer);
+    frame_class * fc = &pool->classes[c];
+    uint32_t item = (uint32_t)((size_t)(buffer - fc->base) / fc->size) + 1;
+
+    if (cache == NULL)
+    {
+        push(fc, item);
+        return;
+    }
+    if (cache->count[c] == COBS_FRAME_CACHE_SIZE)                           // hand half of them back
+    {
+        while (cache->count[c] > COBS_FRAME_CACHE_SIZE / 2) push(fc, cache->index[c][--cache->count[c]]);
+    }
+    cache->index[c][cache->count[c]++] = item;
+}
+
+size_t cobs_frame_capacity(const cobs_frame_pool * pool, const uint8_t * buffer)
+{
+    return pool->classes[class_of(pool, buffer)].size;
+}
+
+uint8_t * cobs_frame_encode(cobs_frame_pool * pool, cobs_frame_cache * cache,
+                            const uint8_t * input, size_t length, size_t * encoded_length)
+{
+    uint8_t * buffer = cobs_frame_alloc(pool, cache, cobs_encoded_length(input, length));
+    *encoded_length = buffer ? cobs_encode(input, length, buffer) : 0;
+    return buffer;
+}
+
+uint8_t * cobs_frame_decode(cobs_frame_pool * pool, cobs_frame_cache * cache,
+                            const uint8_t * input, size_t length, size_t * decoded_length)
+{
+    *decoded_length = 0;
+    uint8_t * buffer = cobs_frame_alloc(pool, cache, length);
+    if (buffer == NULL) return NULL;
+    *decoded_length = cobs_decode(input, length, buffer);
+    if (*decoded_length == 0)
+    {
+        cobs_frame_free(pool, cache, buffer);
+        return NULL;
+    }
+    return buffer;
+}
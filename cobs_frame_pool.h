@@ -0,0 +1,64 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_FRAME_POOL_H
+#define COBS_FRAME_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "cobs.h"
+
+// FRAME POOL. A fixed set of frame buffers, allocated once up front, so that the encode and decode paths
+// never touch the heap. Buffers come in COBS_FRAME_CLASSES size classes: class c holds any encoded frame
+// with a payload of up to COBS_FRAME_CLASS_PAYLOAD(c) bytes (64 B, 256 B, 1 KB ... 64 KB), i.e.
+// COBS_ENCODE_MAX_LENGTH of that. Each class keeps its free buffers on a lock-free list shared by all
+// threads; a thread may also keep a cobs_frame_cache of its own in front of it, which takes buffers from
+// and gives them back to the shared lists in batches. Nothing is ever allocated past the counts given to
+// cobs_frame_pool_create: when a class (and every larger one) is used up, allocation returns NULL.
+#define COBS_FRAME_CLASSES 6
+#define COBS_FRAME_CLASS_PAYLOAD(c) ((size_t)64 << (2 * (c)))
+
+// buffers a cache holds per class before it hands half of them back
+#define COBS_FRAME_CACHE_SIZE 32
+
+typedef struct cobs_frame_pool cobs_frame_pool;
+
+// per-thread cache; set up with cobs_frame_cache_init, and give it back with cobs_frame_cache_flush before
+// the thread goes away or the buffers it holds are lost to the other threads.
+typedef struct
+{
+    uint32_t count[COBS_FRAME_CLASSES];
+    uint32_t index[COBS_FRAME_CLASSES][COBS_FRAME_CACHE_SIZE];
+} cobs_frame_cache;
+
+// create a pool with counts[c] buffers of class c. Returns NULL if the memory cannot be had.
+cobs_frame_pool * cobs_frame_pool_create(const size_t counts[COBS_FRAME_CLASSES]);
+void cobs_frame_pool_destroy(cobs_frame_pool * pool);
+
+void cobs_frame_cache_init(cobs_frame_cache * cache);
+void cobs_frame_cache_flush(cobs_frame_pool * pool, cobs_frame_cache * cache);
+
+// a buffer of at least bytes bytes, from the smallest class that has one free, or NULL. cache may be NULL,
+// in which case the shared lists are used directly.
+uint8_t * cobs_frame_alloc(cobs_frame_pool * pool, cobs_frame_cache * cache, size_t bytes);
+void cobs_frame_free(cobs_frame_pool * pool, cobs_frame_cache * cache, uint8_t * buffer);
+
+// the usable size of a buffer from cobs_frame_alloc
+size_t cobs_frame_capacity(const cobs_frame_pool * pool, const uint8_t * buffer);
+
+// ENCODE into a buffer from the pool, sized by the exact encoded length (cobs_encoded_length) rather than
+// the worst case, so a frame takes the smallest class it really fits. Same output as cobs_encode, with the
+// encoded length in *encoded_length. Returns NULL if the pool has no buffer big enough.
+uint8_t * cobs_frame_encode(cobs_frame_pool * pool, cobs_frame_cache * cache,
+                            const uint8_t * input, size_t length, size_t * encoded_length);
+
+// DECODE into a buffer from the pool, as cobs_decode. Returns NULL (and no buffer is kept) if the pool
+// has no buffer big enough or the frame is invalid; *decoded_length is then 0.
+uint8_t * cobs_frame_decode(cobs_frame_pool * pool, cobs_frame_cache * cache,
+                            const uint8_t * input, size_t length, size_t * decoded_length);
+
+#endif
@@ -0,0 +1,24 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_INTERNAL_H
+#define COBS_INTERNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// For the other parts of the library, not for users of it.
+
+// ENCODE with the kernel cobs_encode_frame uses, but without counting the frame in the stats: for encoders
+// that build one frame out of several pieces and count it once, with cobs_stats_count_encode.
+size_t cobs_encode_uncounted(const uint8_t * restrict input, size_t length, uint8_t * restrict output, bool terminate);
+
+// count one frame of length payload bytes, encoded into output[0..encoded), in the stats (nothing without
+// COBS_ENABLE_STATS)
+void cobs_stats_count_encode(const uint8_t * output, size_t length, size_t encoded);
+
+#endif
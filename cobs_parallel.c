@@ -0,0 +1,524 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#include "cobs_parallel.h"
+#include "cobs.h"
+#include "cobs_internal.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// the smallest piece of input worth handing to a thread, and how many pieces to aim for per thread
+#define MIN_CHUNK (64 * 1024)
+#define CHUNKS_PER_THREAD 4
+
+#define NO_NULL SIZE_MAX
+
+struct cobs_pool
+{
+    pthread_t * threads;
+    unsigned count;
+    pthread_mutex_t lock;
+    pthread_cond_t start;                   // workers wait here for the next batch
+    pthread_cond_t finished;                // the caller waits here for the batch to drain
+    void (*task)(void * context, size_t index);
+    void * context;
+    size_t next;                            // next task to hand out
+    size_t total;
+    size_t done;
+    unsigned long generation;               // bumped for every batch
+    bool stop;
+};
+
+// called and returns with pool->lock held
+static void run_tasks(cobs_pool * pool)
+{
+    while (pool->next < pool->total)
+    {
+        size_t index = pool->next++;
+        void (*task)(void *, size_t) = pool->task;
+        void * context = pool->context;
+        pthread_mutex_unlock(&pool->lock);
+        task(context, index);
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->done == pool->total) pthread_cond_broadcast(&pool->finished);
+    }
+}
+
+static void * worker(void * arg)
+{
+    cobs_pool * pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->stop && pool->generation == seen) pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stop) break;
+        seen = pool->generation;
+        run_tasks(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+cobs_pool * cobs_pool_create(unsigned threads)
+{
+    if (threads == 0)
+    {
+#ifdef _SC_NPROCESSORS_ONLN
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 1 ? (unsigned)cpus - 1 : 1;
+#else
+        threads = 1;
+#endif
+    }
+
+    cobs_pool * pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) return NULL;
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (pool->threads == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    for (; pool->count < threads; pool->count++)
+    {
+        if (pthread_create(&pool->threads[pool->count], NULL, worker, pool) != 0)
+        {
+            cobs_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void cobs_pool_destroy(cobs_pool * pool)
+{
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned i = 0; i < pool->count; i++) pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+void cobs_pool_run(cobs_pool * pool, void (*task)(void * context, size_t index), void * context, size_t count)
+{
+    if (pool == NULL)
+    {
+        for (size_t i = 0; i < count; i++) task(context, i);
+        return;
+    }
+    if (count == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->next = 0;
+    pool->total = count;
+    pool->done = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    run_tasks(pool);
+    while (pool->done < pool->total) pthread_cond_wait(&pool->finished, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+typedef struct
+{
+    const uint8_t * input;
+    size_t length;
+    uint8_t * output;
+    size_t chunks;
+    size_t * first_null;                    // per chunk: its first NULL, or NO_NULL
+    size_t * last_null;                     // per chunk: its last NULL, if it has one
+    size_t pieces;
+    size_t * cut;                           // piece i is input[cut[i] .. cut[i + 1])
+    size_t * size;                          // piece i's encoded size, then (after the prefix sum) its output offset
+} parallel_job;
+
+static void scan_chunk(void * context, size_t i)
+{
+    parallel_job * job = context;
+    size_t start = i * job->length / job->chunks;
+    size_t end = (i + 1) * job->length / job->chunks;
+    const uint8_t * null = memchr(job->input + start, 0, end - start);
+
+    job->first_null[i] = NO_NULL;
+    if (null == NULL) return;
+    job->first_null[i] = (size_t)(null - job->input);
+    while (job->input[end - 1] != 0) end--;
+    job->last_null[i] = end - 1;
+}
+
+// Every piece starts a fresh block. If it ends just after a NULL, its share of the output is everything
+// cobs_encode gives for it bar the final block, which is really the first block of the next piece -
+// encoding the piece minus that NULL gives the same bytes (short of a code 0x01 when the piece ends in a
+// full 254 byte block). A piece that ends on a 254 byte block boundary encodes to exactly its share.
+static bool piece_ends_in_null(const parallel_job * job, size_t p)
+{
+    return p + 1 < job->pieces && job->input[job->cut[p + 1] - 1] == 0;
+}
+
+static void size_piece(void * context, size_t p)
+{
+    parallel_job * job = context;
+    size_t start = job->cut[p];
+    size_t size = cobs_encoded_length(job->input + start, job->cut[p + 1] - start);
+
+    if (p + 1 < job->pieces && COBS_ENCODE_TERMINATES) size--;
+    if (piece_ends_in_null(job, p)) size--;
+    job->size[p] = size;
+}
+
+static void encode_piece(void * context, size_t p)
+{
+    parallel_job * job = context;
+    size_t start = job->cut[p];
+    size_t length = job->cut[p + 1] - start;
+    uint8_t * output = job->output + job->size[p];
+
+    if (p + 1 == job->pieces)
+    {
+        cobs_encode_uncounted(job->input + start, length, output, COBS_ENCODE_TERMINATES);
+        return;
+    }
+    bool ends_in_null = piece_ends_in_null(job, p);
+    size_t written = cobs_encode_uncounted(job->input + start, length - ends_in_null, output, false);
+    if (written < job->size[p + 1] - job->size[p]) output[written] = 0x01;
+}
+
+size_t cobs_encode_parallel(cobs_pool * pool, const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    if (pool == NULL || length < COBS_PARALLEL_THRESHOLD) return cobs_encode(input, length, output);
+
+    size_t chunks = (size_t)(pool->count + 1) * CHUNKS_PER_THREAD;
+    if (chunks > length / MIN_CHUNK) chunks = length / MIN_CHUNK;
+    if (chunks < 2) return cobs_encode(input, length, output);
+
+    size_t * scratch = malloc(sizeof(size_t) * (4 * chunks + 2));
+    if (scratch == NULL) return cobs_encode(input, length, output);
+    parallel_job job = { input, length, output, chunks, scratch, scratch + chunks, 0,
+                         scratch + 2 * chunks, scratch + 3 * chunks + 1 };
+
+    // 1. find the NULLs nearest each chunk boundary
+    cobs_pool_run(pool, scan_chunk, &job, chunks);
+
+    // 2. move each boundary to the first block boundary at or after it
+    size_t last_null = NO_NULL;                             // the last NULL before the current chunk
+    job.cut[job.pieces++] = 0;
+    for (size_t i = 1; i < chunks; i++)
+    {
+        if (job.first_null[i - 1] != NO_NULL) last_null = job.last_null[i - 1];
+        size_t start = i * length / chunks;
+        size_t cut;
+        if (job.first_null[i] != NO_NULL)
+        {
+            cut = job.first_null[i] + 1;
+        }
+        else                                                // no NULL in this chunk: cut where a 254 byte block ends
+        {
+            size_t block_start = last_null == NO_NULL ? 0 : last_null + 1;
+            cut = start + (254 - (start - block_start) % 254) % 254;
+        }
+        if (cut < length && cut > job.cut[job.pieces - 1]) job.cut[job.pieces++] = cut;
+    }
+    job.cut[job.pieces] = length;
+
+    // 3. size every piece, and turn the sizes into output offsets
+    cobs_pool_run(pool, size_piece, &job, job.pieces);
+    size_t total = 0;
+    for (size_t p = 0; p < job.pieces; p++)
+    {
+        size_t size = job.size[p];
+        job.size[p] = total;
+        total += size;
+    }
+    job.size[job.pieces] = total;
+
+    // 4. encode, counting the frame once rather than once per piece
+    cobs_pool_run(pool, encode_piece, &job, job.pieces);
+    cobs_stats_count_encode(output, length, total);
+
+    free(scratch);
+    return total;
+}
+
+// frames per slot are capped so that their descriptors can live in the slot
+#define FRAMES_PER_SLOT 256
+
+typedef struct
+{
+    uint8_t * encoded;                      // complete frames, each followed by its terminator
+    uint8_t * decoded;                      // output arena for cobs_decode_batch
+    size_t length;                          // bytes of complete frames in encoded
+    size_t count;                           // complete frames in encoded
+    bool oversized[FRAMES_PER_SLOT];        // frame i stands in for one that was too long for a slot
+    cobs_frame frames[FRAMES_PER_SLOT];
+    bool done;                              // decoded, waiting its turn to be delivered
+} pipeline_slot;
+
+struct cobs_pipeline
+{
+    pthread_t * threads;
+    unsigned count;
+    size_t slot_bytes;
+    size_t depth;
+    pipeline_slot * slots;                  // slot for sequence number n is slots[n % depth]
+    uint8_t * buffers;
+    cobs_frame_handler handler;
+    void * context;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;                   // decoders wait here for a slot to be submitted
+    pthread_cond_t space;                   // the splitter and flush wait here for slots to be delivered
+    unsigned long long submitted;           // slots handed to the decoders
+    unsigned long long claimed;             // slots taken by a decoder
+    unsigned long long delivered;           // slots handed to the handler, and so free again
+    bool delivering;                        // a decoder is busy calling the handler
+    bool stop;
+
+    // splitter state, only ever touched by the pushing thread
+    pipeline_slot * filling;                // the slot being filled (sequence number submitted), or NULL
+    size_t partial;                         // bytes of an unfinished frame after filling->length
+    bool skipping;                          // dropping the rest of an oversized frame
+};
+
+static void deliver_slot(cobs_pipeline * pl, pipeline_slot * slot)
+{
+    for (size_t i = 0; i < slot->count; i++)
+    {
+        const cobs_frame * frame = &slot->frames[i];
+        if (frame->status == COBS_OK) pl->handler(pl->context, COBS_OK, slot->decoded + frame->offset, frame->length);
+        else pl->handler(pl->context, frame->status, NULL, 0);
+    }
+}
+
+static void * pipeline_worker(void * arg)
+{
+    cobs_pipeline * pl = arg;
+
+    pthread_mutex_lock(&pl->lock);
+    for (;;)
+    {
+        while (!pl->stop && pl->claimed == pl->submitted) pthread_cond_wait(&pl->ready, &pl->lock);
+        if (pl->claimed == pl->submitted) break;
+        pipeline_slot * slot = &pl->slots[pl->claimed++ % pl->depth];
+        pthread_mutex_unlock(&pl->lock);
+
+        size_t trailing;
+        cobs_decode_batch(slot->encoded, slot->length, slot->decoded, slot->frames, slot->count, &trailing);
+        for (size_t i = 0; i < slot->count; i++)
+        {
+            if (slot->oversized[i])
+            {
+                slot->frames[i].status = COBS_ERR_OVERFLOW;
+                slot->frames[i].length = 0;
+            }
+        }
+
+        pthread_mutex_lock(&pl->lock);
+        slot->done = true;
+        if (pl->delivering) continue;                       // whoever is delivering will get to it
+        pl->delivering = true;
+        for (;;)
+        {
+            pipeline_slot * head = &pl->slots[pl->delivered % pl->depth];
+            if (pl->delivered == pl->claimed || !head->done) break;
+            pthread_mutex_unlock(&pl->lock);
+            deliver_slot(pl, head);
+            pthread_mutex_lock(&pl->lock);
+            head->done = false;
+            pl->delivered++;
+            pthread_cond_broadcast(&pl->space);
+        }
+        pl->delivering = false;
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+// the slot being filled, waiting for one to come free if need be
+static pipeline_slot * filling_slot(cobs_pipeline * pl)
+{
+    if (pl->filling == NULL)
+    {
+        pthread_mutex_lock(&pl->lock);
+        while (pl->submitted - pl->delivered >= pl->depth) pthread_cond_wait(&pl->space, &pl->lock);
+        pthread_mutex_unlock(&pl->lock);
+        pl->filling = &pl->slots[pl->submitted % pl->depth];
+        pl->filling->length = 0;
+        pl->filling->count = 0;
+    }
+    return pl->filling;
+}
+
+// hand the slot being filled to the decoders; an unfinished frame at its end moves on to the next slot
+static void submit_slot(cobs_pipeline * pl)
+{
+    const uint8_t * tail = pl->filling->encoded + pl->filling->length;
+
+    pthread_mutex_lock(&pl->lock);
+    pl->submitted++;
+    pthread_cond_signal(&pl->ready);
+    pthread_mutex_unlock(&pl->lock);
+    pl->filling = NULL;
+    if (pl->partial) memmove(filling_slot(pl)->encoded, tail, pl->partial); // with depth 1 it is the same slot
+}
+
+static void add_frame(cobs_pipeline * pl, pipeline_slot * slot, bool oversized)
+{
+    slot->encoded[slot->length + pl->partial] = COBS_TERMINATOR;
+    slot->oversized[slot->count] = oversized;
+    slot->length += pl->partial + 1;
+    slot->count++;
+    pl->partial = 0;
+    if (slot->count == FRAMES_PER_SLOT) submit_slot(pl);
+}
+
+void cobs_pipeline_push(cobs_pipeline * pl, const uint8_t * input, size_t length)
+{
+    const uint8_t * p = input;
+    const uint8_t * end = input + length;
+
+    while (p < end)
+    {
+        const uint8_t * t = memchr(p, COBS_TERMINATOR, (size_t)(end - p));
+        size_t n = (size_t)((t ? t : end) - p);
+        if (pl->skipping)
+        {
+            if (t == NULL) break;
+            pl->skipping = false;
+            p = t + 1;
+            continue;
+        }
+
+        pipeline_slot * slot = filling_slot(pl);
+        if (pl->partial + n + 1 > pl->slot_bytes)           // can never fit: drop it, and leave a stand-in
+        {                                                   // (a 0x02 code with no data byte) to report it
+            pl->partial = 0;
+            if (slot->length + 2 > pl->slot_bytes)
+            {
+                submit_slot(pl);
+                slot = filling_slot(pl);
+            }
+            slot->encoded[slot->length] = 0x02;
+            pl->partial = 1;
+            add_frame(pl, slot, true);
+            if (t == NULL)
+            {
+                pl->skipping = true;
+                break;
+            }
+            p = t + 1;
+            continue;
+        }
+        if (slot->length + pl->partial + n + 1 > pl->slot_bytes)
+        {
+            submit_slot(pl);
+            slot = filling_slot(pl);
+        }
+        memcpy(slot->encoded + slot->length + pl->partial, p, n);
+        pl->partial += n;
+        p += n;
+        if (t == NULL) break;
+        p++;                                                // the terminator
+        if (pl->partial) add_frame(pl, slot, false);        // (empty frames are skipped)
+    }
+
+    if (pl->filling && pl->filling->count) submit_slot(pl); // don't sit on complete frames
+}
+
+void cobs_pipeline_flush(cobs_pipeline * pl)
+{
+    if (pl->filling && pl->filling->count) submit_slot(pl);
+    pthread_mutex_lock(&pl->lock);
+    while (pl->delivered < pl->submitted) pthread_cond_wait(&pl->space, &pl->lock);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+cobs_pipeline * cobs_pipeline_create(unsigned workers, size_t slot_bytes, size_t depth,
+                                     cobs_frame_handler handler, void * context)
+{
+    if (slot_bytes < 3 || depth == 0) return NULL;
+    if (workers == 0)
+    {
+#ifdef _SC_NPROCESSORS_ONLN
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 1 ? (unsigned)cpus - 1 : 1;
+#else
+        workers = 1;
+#endif
+    }
+
+    cobs_pipeline * pl = calloc(1, sizeof(*pl));
+    if (pl == NULL) return NULL;
+    pl->slot_bytes = slot_bytes;
+    pl->depth = depth;
+    pl->handler = handler;
+    pl->context = context;
+    pl->threads = calloc(workers, sizeof(pthread_t));
+    pl->slots = calloc(depth, sizeof(pipeline_slot));
+    pl->buffers = malloc(2 * depth * slot_bytes);
+    if (pl->threads == NULL || pl->slots == NULL || pl->buffers == NULL)
+    {
+        free(pl->threads);
+        free(pl->slots);
+        free(pl->buffers);
+        free(pl);
+        return NULL;
+    }
+    for (size_t i = 0; i < depth; i++)
+    {
+        pl->slots[i].encoded = pl->buffers + 2 * i * slot_bytes;
+        pl->slots[i].decoded = pl->slots[i].encoded + slot_bytes;
+    }
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->ready, NULL);
+    pthread_cond_init(&pl->space, NULL);
+
+    for (; pl->count < workers; pl->count++)
+    {
+        if (pthread_create(&pl->threads[pl->count], NULL, pipeline_worker, pl) != 0)
+        {
+            cobs_pipeline_destroy(pl);
+            return NULL;
+        }
+    }
+    return pl;
+}
+
+void cobs_pipeline_destroy(cobs_pipeline * pl)
+{
+    if (pl == NULL) return;
+    if (pl->count) cobs_pipeline_flush(pl);
+    pthread_mutex_lock(&pl->lock);
+    pl->stop = true;
+    pthread_cond_broadcast(&pl->ready);
+    pthread_mutex_unlock(&pl->lock);
+    for (unsigned i = 0; i < pl->count; i++) pthread_join(pl->threads[i], NULL);
+    pthread_cond_destroy(&pl->space);
+    pthread_cond_destroy(&pl->ready);
+    pthread_mutex_destroy(&pl->lock);
+    free(pl->threads);
+    free(pl->slots);
+    free(pl->buffers);
+    free(pl);
+}
@@ -0,0 +1,57 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_PARALLEL_H
+#define COBS_PARALLEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cobs.h"
+
+// inputs shorter than this are encoded on the calling thread alone; splitting them costs more than it saves
+#ifndef COBS_PARALLEL_THRESHOLD
+#define COBS_PARALLEL_THRESHOLD (1024 * 1024)
+#endif
+
+// A pool of worker threads, kept between calls. The calling thread works alongside them.
+typedef struct cobs_pool cobs_pool;
+
+// create a pool with the given number of worker threads (0 = one per online CPU, less the caller).
+// Returns NULL if the threads cannot be started.
+cobs_pool * cobs_pool_create(unsigned threads);
+void cobs_pool_destroy(cobs_pool * pool);
+
+// run task(context, i) for i = 0 .. count-1 spread over the pool and the calling thread, and return when all are done
+void cobs_pool_run(cobs_pool * pool, void (*task)(void * context, size_t index), void * context, size_t count);
+
+// PARALLEL ENCODE. Same output and return value as cobs_encode, which it calls for inputs below
+// COBS_PARALLEL_THRESHOLD or when pool is NULL. The input is cut at block boundaries (just after a NULL, or at
+// a multiple of 254 bytes after one), each piece's encoded size is found in parallel, a prefix sum gives every
+// piece its place in the output, and then the pieces are encoded concurrently.
+size_t cobs_encode_parallel(cobs_pool * pool, const uint8_t * restrict input, size_t length, uint8_t * restrict output);
+
+// ORDERED DECODE PIPELINE. The thread calling cobs_pipeline_push splits the stream into frames at each
+// COBS_TERMINATOR and packs them into slots of up to slot_bytes bytes; a set of decoder threads take slots
+// as they fill up and decode them, and the frames are handed to the handler in the order they arrived, one
+// call at a time, from whichever thread finished the oldest slot. At most depth slots are in flight: when
+// they are all taken, push waits (backpressure), so memory use is fixed at about 2 * depth * slot_bytes.
+// A frame longer than slot_bytes - 1 encoded bytes is reported with COBS_ERR_OVERFLOW and dropped.
+typedef struct cobs_pipeline cobs_pipeline;
+
+// Returns NULL if memory or threads cannot be had.
+cobs_pipeline * cobs_pipeline_create(unsigned workers, size_t slot_bytes, size_t depth,
+                                     cobs_frame_handler handler, void * context);
+
+// feed length bytes of the stream; an unfinished frame at the end is kept for the next push
+void cobs_pipeline_push(cobs_pipeline * pipeline, const uint8_t * input, size_t length);
+
+// wait until every complete frame pushed so far has been handed to the handler
+void cobs_pipeline_flush(cobs_pipeline * pipeline);
+
+// flush, then stop the decoder threads
+void cobs_pipeline_destroy(cobs_pipeline * pipeline);
+
+#endif
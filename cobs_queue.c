@@ -0,0 +1,132 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#include "cobs_queue.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// each side's fields get a cache line of their own, so that the two threads never share one
+#define LINE 64
+
+// Every record is a header (its length) then the frame, padded to a multiple of HEADER so that headers
+// stay aligned. A record never wraps: when it does not fit before the end of the ring, a WRAP header is
+// left in the gap and the record goes at the start. Positions count bytes from the start of time and are
+// taken modulo the capacity, so tail - head is always the number of bytes in use. A record that has to skip
+// the end of the ring needs to_end + record bytes free, where to_end < record; only if records are held to
+// half the capacity does that always fit once the queue has drained, wherever the tail happens to be.
+#define HEADER 8
+#define WRAP UINT32_MAX
+#define RECORD(length) (HEADER + (((length) + HEADER - 1) & ~(size_t)(HEADER - 1)))
+
+struct cobs_queue
+{
+    uint8_t * buffer;
+    size_t mask;                            // capacity - 1
+    void * memory;
+    uint8_t pad0[LINE - 3 * sizeof(void *)];
+
+    // producer
+    size_t tail;                            // published: records before it are complete
+    size_t head_cache;                      // the consumer's head, as last seen
+    size_t reserved;                        // where the reserved record's header goes
+    uint8_t pad1[LINE - 3 * sizeof(size_t)];
+
+    // consumer
+    size_t head;                            // published: records before it are released
+    size_t tail_cache;                      // the producer's tail, as last seen
+    size_t peeked;                          // just past the peeked record, 0 if none
+    uint8_t pad2[LINE - 3 * sizeof(size_t)];
+};
+
+cobs_queue * cobs_queue_create(size_t capacity)
+{
+    size_t size = LINE;
+    while (size < capacity) size <<= 1;
+    void * memory = malloc(sizeof(cobs_queue) + size + 2 * LINE);
+    if (memory == NULL) return NULL;
+    cobs_queue * queue = (cobs_queue *)(((uintptr_t)memory + LINE - 1) & ~(uintptr_t)(LINE - 1));
+    memset(queue, 0, sizeof(*queue));
+    queue->memory = memory;
+    queue->buffer = (uint8_t *)queue + sizeof(cobs_queue);
+    queue->mask = size - 1;
+    return queue;
+}
+
+void cobs_queue_destroy(cobs_queue * queue)
+{
+    if (queue) free(queue->memory);
+}
+
+static void put_header(uint8_t * at, uint32_t value)
+{
+    memcpy(at, &value, sizeof(value));
+}
+
+static uint32_t get_header(const uint8_t * at)
+{
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+uint8_t * cobs_queue_reserve(cobs_queue * queue, size_t max_length)
+{
+    size_t capacity = queue->mask + 1;
+    size_t record = RECORD(max_length);
+    if (max_length >= WRAP || record > capacity / 2) return NULL;     // see below
+
+    size_t tail = queue->tail;
+    size_t to_end = capacity - (tail & queue->mask);
+    size_t need = record > to_end ? to_end + record : record;
+    if (need > capacity - (tail - queue->head_cache))
+    {
+        queue->head_cache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if (need > capacity - (tail - queue->head_cache)) return NULL;
+    }
+    if (record > to_end)
+    {
+        put_header(queue->buffer + (tail & queue->mask), WRAP);     // published along with the record
+        tail += to_end;
+    }
+    queue->reserved = tail;
+    return queue->buffer + (tail & queue->mask) + HEADER;
+}
+
+void cobs_queue_commit(cobs_queue * queue, size_t length)
+{
+    size_t at = queue->reserved;
+    put_header(queue->buffer + (at & queue->mask), (uint32_t)length);
+    __atomic_store_n(&queue->tail, at + RECORD(length), __ATOMIC_RELEASE);
+}
+
+uint8_t * cobs_queue_peek(cobs_queue * queue, size_t * length)
+{
+    size_t head = queue->head;
+    if (head == queue->tail_cache)
+    {
+        queue->tail_cache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if (head == queue->tail_cache) return NULL;
+    }
+    uint32_t header = get_header(queue->buffer + (head & queue->mask));
+    if (header == WRAP)                                     // the record is at the start of the ring
+    {
+        head += queue->mask + 1 - (head & queue->mask);
+        header = get_header(queue->buffer);
+    }
+    *length = header;
+    queue->peeked = head + RECORD(header);
+    return queue->buffer + (head & queue->mask) + HEADER;
+}
+
+void cobs_queue_release(cobs_queue * queue)
+{
+    if (queue->peeked == 0) return;
+    __atomic_store_n(&queue->head, queue->peeked, __ATOMIC_RELEASE);
+    queue->peeked = 0;
+}
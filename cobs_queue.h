@@ -0,0 +1,42 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_QUEUE_H
+#define COBS_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// FRAME QUEUE. A bounded, lock-free hand-off of variable length frames from exactly one producer thread (e.g.
+// the one reading the device) to exactly one consumer thread (e.g. the one decoding). Frames are stored inline
+// in one ring of bytes, each behind a small header and contiguous in memory, so neither side copies: the
+// producer reserves room and writes the frame straight into the ring, and the consumer gets a pointer to it,
+// which it may decode in place (cobs_decode_inplace) before releasing it. The producer's and the consumer's
+// positions sit on cache lines of their own, and each side keeps a copy of the other's, so a frame costs one
+// shared cache line transfer each way when the queue is busy, and nothing blocks: a full or empty queue just
+// returns NULL, and the caller decides whether to spin, yield or sleep.
+typedef struct cobs_queue cobs_queue;
+
+// create a queue of at least capacity bytes (rounded up to a power of two). Each frame takes its length
+// rounded up to 8, plus 8, and may take no more than half the capacity. Returns NULL if the memory cannot be had.
+cobs_queue * cobs_queue_create(size_t capacity);
+void cobs_queue_destroy(cobs_queue * queue);
+
+// PRODUCER. Room for a frame of up to max_length bytes, or NULL if the queue is too full - or always NULL if
+// max_length rounded up to 8, plus 8, is more than half the capacity, as a frame that size could find itself
+// unable to fit around the end of the ring even with the queue empty. Nothing is visible to the consumer until
+// commit, which publishes the first length bytes (length <= max_length). A reservation that is not wanted is
+// dropped by not calling commit: just reserve again (committing 0 would publish an empty frame).
+uint8_t * cobs_queue_reserve(cobs_queue * queue, size_t max_length);
+void cobs_queue_commit(cobs_queue * queue, size_t length);
+
+// CONSUMER. The oldest frame, with its length in *length, or NULL if the queue is empty. The frame stays in
+// the queue, and may be written to, until release; peeking again before that returns the same frame.
+uint8_t * cobs_queue_peek(cobs_queue * queue, size_t * length);
+void cobs_queue_release(cobs_queue * queue);
+
+#endif
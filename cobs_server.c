@@ -0,0 +1,176 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "cobs_server.h"
+
+#define READ_BYTES 65536        // most taken from one port per wakeup
+#define EVENTS 64               // most ports handled per epoll_wait
+
+typedef struct port
+{
+    int fd;
+    int number;
+    bool removed;
+    struct port * next;         // on the retired list, once removed during a poll
+    cobs_receiver rx;
+    uint8_t frame[];            // the receiver's buffer
+} port;
+
+struct cobs_server
+{
+    int epoll_fd;
+    size_t max_frame;
+    cobs_port_handler handler;
+    void * context;
+    port ** ports;              // by port number, NULL when free
+    int count;                  // slots in ports[]
+    bool polling;
+    port * retired;             // removed while their events might still be pending; freed after the poll
+    int delivered;
+    uint8_t input[READ_BYTES];
+};
+
+cobs_server * cobs_server_create(size_t max_frame, cobs_port_handler handler, void * context)
+{
+    cobs_server * server = calloc(1, sizeof(cobs_server));
+    if (server == NULL) return NULL;
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0)
+    {
+        free(server);
+        return NULL;
+    }
+    server->max_frame = max_frame;
+    server->handler = handler;
+    server->context = context;
+    return server;
+}
+
+void cobs_server_destroy(cobs_server * server)
+{
+    if (server == NULL) return;
+    for (int i = 0; i < server->count; i++) free(server->ports[i]);
+    free(server->ports);
+    close(server->epoll_fd);
+    free(server);
+}
+
+int cobs_server_add(cobs_server * server, int fd)
+{
+    int number = 0;
+    while (number < server->count && server->ports[number]) number++;
+    if (number == server->count)
+    {
+        int count = server->count ? 2 * server->count : 16;
+        port ** ports = realloc(server->ports, count * sizeof(port *));
+        if (ports == NULL) return -1;
+        for (int i = server->count; i < count; i++) ports[i] = NULL;
+        server->ports = ports;
+        server->count = count;
+    }
+
+    port * p = malloc(sizeof(port) + server->max_frame);
+    if (p == NULL) return -1;
+    p->fd = fd;
+    p->number = number;
+    p->removed = false;
+    p->next = NULL;
+    cobs_receiver_init(&p->rx, p->frame, server->max_frame);
+
+    int flags = fcntl(fd, F_GETFL);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = p };
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        free(p);
+        return -1;
+    }
+    server->ports[number] = p;
+    return number;
+}
+
+void cobs_server_remove(cobs_server * server, int port_number)
+{
+    if (port_number < 0 || port_number >= server->count || server->ports[port_number] == NULL) return;
+    port * p = server->ports[port_number];
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, p->fd, NULL);
+    server->ports[port_number] = NULL;
+    p->removed = true;
+    // the callback may remove the very port being handled, or one with an event further down the list
+    if (server->polling)
+    {
+        p->next = server->retired;
+        server->retired = p;
+    }
+    else
+    {
+        free(p);
+    }
+}
+
+// one read from a ready port, decoded as far as it goes. The callback may remove the port at any frame, so
+// that is checked before each one.
+static void service(cobs_server * server, port * p)
+{
+    ssize_t n = read(p->fd, server->input, READ_BYTES);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n <= 0)                 // end of file, or a pty or serial line that has hung up (EIO)
+    {
+        int number = p->number;
+        cobs_server_remove(server, number);
+        server->handler(server->context, number, COBS_CLOSED, NULL, 0);
+        return;
+    }
+
+    const uint8_t * input = server->input;
+    size_t length = (size_t)n;
+    while (length > 0 && !p->removed)
+    {
+        size_t consumed;
+        cobs_status status = cobs_receiver_feed(&p->rx, input, length, &consumed);
+        input += consumed;
+        length -= consumed;
+        if (status == COBS_OK)
+        {
+            server->delivered++;
+            server->handler(server->context, p->number, status, p->rx.buffer, p->rx.length);
+        }
+        else if (status != COBS_INCOMPLETE)     // a bad frame; INCOMPLETE only means the input ran out
+        {
+            server->handler(server->context, p->number, status, NULL, 0);
+        }
+    }
+}
+
+int cobs_server_poll(cobs_server * server, int timeout_ms)
+{
+    struct epoll_event events[EVENTS];
+    int ready = epoll_wait(server->epoll_fd, events, EVENTS, timeout_ms);
+    if (ready < 0) return errno == EINTR ? 0 : -1;
+
+    server->polling = true;
+    server->delivered = 0;
+    for (int i = 0; i < ready; i++)
+    {
+        port * p = events[i].data.ptr;
+        if (!p->removed) service(server, p);
+    }
+    server->polling = false;
+    while (server->retired)
+    {
+        port * p = server->retired;
+        server->retired = p->next;
+        free(p);
+    }
+    return server->delivered;
+}
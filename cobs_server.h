@@ -0,0 +1,44 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_SERVER_H
+#define COBS_SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "cobs.h"
+
+// FRAME SERVER. Receives frames from many ports (serial lines, ptys, sockets, pipes - any file descriptor that
+// can be polled) on one thread, instead of a thread per port blocked in read(). The descriptors are watched
+// with epoll, each ready one gets one read() per wakeup, so a busy port cannot starve the others, and the
+// bytes go through that port's own cobs_receiver, which keeps the frame being reassembled between reads.
+// Every decoded frame, and every bad one, is handed to a callback along with the port it came from. A server
+// is not thread safe: for more than one core, run one server per thread and share the ports out among them.
+typedef struct cobs_server cobs_server;
+
+// called with each frame as it is decoded (valid only until the callback returns), with each bad frame (an
+// error status, frame NULL) and, once, when a port hangs up or fails (status COBS_CLOSED, frame NULL), after
+// which the port has been removed from the server. The descriptor is never closed by the server.
+typedef void (*cobs_port_handler)(void * context, int port, cobs_status status, const uint8_t * frame, size_t length);
+
+// create a server for frames of up to max_frame decoded bytes. Returns NULL if it cannot be had.
+cobs_server * cobs_server_create(size_t max_frame, cobs_port_handler handler, void * context);
+void cobs_server_destroy(cobs_server * server);
+
+// ADD a descriptor, which is switched to non-blocking mode. Returns the port number the callback will be given
+// (the lowest one free), or -1 on failure.
+int cobs_server_add(cobs_server * server, int fd);
+
+// stop watching a port and drop any frame it had half received
+void cobs_server_remove(cobs_server * server, int port);
+
+// WAIT up to timeout_ms (-1 for ever, 0 not at all) for input on any port, and handle everything that is
+// ready. Returns the number of frames delivered, or -1 if the wait itself failed (errno says why; EINTR
+// is not a failure and returns 0).
+int cobs_server_poll(cobs_server * server, int timeout_ms);
+
+#endif
@@ -2,11 +2,37 @@
  *
  * Redistribution and use in source and binary forms are permitted, with or without modification.
  */
+#ifdef COBS_TEST_SERVER
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include "cobs.h"
+#ifndef COBS_TEST_CORE_ONLY
+#include "cobs_parallel.h"
+#include "cobs_frame_pool.h"
+#include "cobs_zpe.h"
+#include "cobs_crc.h"
+#include "cobs_queue.h"
+#include "cobs_view.h"
+#include <pthread.h>
+#ifdef _WIN32                   // let the other thread of a threaded test run while this one waits on it
+#include <windows.h>
+#define test_yield() SwitchToThread()
+#else
+#include <sched.h>
+#define test_yield() sched_yield()
+#endif
+#ifdef COBS_TEST_SERVER     // the frame server is epoll based, so Linux only, and in a library of its own
+#include "cobs_server.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#endif
+#endif
 
 #define MARKER_BYTE 0xAB
 #define MAX_TEST_SIZE 260	
@@ -77,6 +103,43 @@
 			return false; \
 		}	\
 	}
+
+#ifndef COBS_TEST_CORE_ONLY
+#define INPLACE_FWD_TEST	\
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));	\
+	size_t headroom = COBS_ENCODE_HEADROOM(sizeof(test_data));	\
+	memcpy(working_buffer + headroom, test_data, sizeof(test_data));	\
+	size_t inplace_encoded = cobs_encode_inplace( working_buffer, headroom, sizeof(test_data) ); \
+	ASSERT_EQUAL_LUINT( inplace_encoded, encoded_length ); \
+	ASSERT_EQUAL_MEM( "INPLACE FWD", working_buffer, expected, sizeof(expected) ); \
+	if (inplace_encoded > sizeof(expected)) ASSERT_EQUAL_LUINT( working_buffer[sizeof(expected)], 0 );	\
+	for (size_t i = headroom + sizeof(test_data); i < MAX_TEST_SIZE; i++) \
+	{	\
+		if (i >= inplace_encoded && working_buffer[i] != MARKER_BYTE)	\
+		{	\
+			printf("Failed: in place encoding overwrote buffer at pos %lu in %s\n", (unsigned long)i, __func__); \
+			return false; \
+		}	\
+	}
+
+#define INPLACE_REV_TEST	\
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));	\
+	memcpy(working_buffer, expected, sizeof(expected));	\
+	size_t inplace_length = cobs_decode_inplace( working_buffer, sizeof(expected) ); \
+	ASSERT_EQUAL_LUINT( inplace_length, sizeof(test_data)); \
+	ASSERT_EQUAL_MEM( "INPLACE", working_buffer, test_data, sizeof(test_data) );	\
+	for (uint16_t i = sizeof(expected); i < MAX_TEST_SIZE; i++) \
+	{	\
+		if (working_buffer[i] != MARKER_BYTE)	\
+		{	\
+			printf("Failed: in place decoding overwrote buffer at pos %d in %s\n", i, __func__); \
+			return false; \
+		}	\
+	}
+#else
+#define INPLACE_FWD_TEST
+#define INPLACE_REV_TEST
+#endif
 	
 static unsigned int test_count = 0;
 static uint8_t working_buffer[MAX_TEST_SIZE];
@@ -89,6 +152,8 @@ bool test_single_null( void )
     uint8_t expected[] = { 1, 1 };
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -100,6 +165,8 @@ bool test_double_null( void )
     uint8_t expected[] = { 1, 1, 1 };
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -111,6 +178,8 @@ bool test_hex1( void )
     uint8_t expected[] = { 2, 1 };
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
     return true;
 }
 
@@ -121,6 +190,8 @@ bool test_cobs_encode_three_bytes(void) // Wikipedia Example 3
 	uint8_t expected[] = { 0x01, 0x02, 0x11, 0x01 };
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -131,6 +202,8 @@ bool test_cobs_encode_short_with_null(void) // Wikipedia Example 4
 	uint8_t expected[] = { 0x03, 0x11, 0x22, 0x02, 0x33 };
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -141,6 +214,8 @@ bool test_cobs_encode_short_no_null(void) // Wikipedia Example 5
 	uint8_t expected[] = { 0x05, 0x11, 0x22, 0x33, 0x44 };
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -151,6 +226,8 @@ bool test_cobs_encode_short_successive_nulls(void) // Wikipedia Example 6
 	uint8_t expected[] = { 0x02, 0x11, 0x01, 0x01, 0x01 };
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -172,6 +249,8 @@ bool test_cobs_encode_254_bytes_no_null(void) // Wikipedia Example 7
     
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 	
 }
@@ -195,6 +274,8 @@ bool test_cobs_encode_255_bytes_leading_null(void) // Wikipedia Example 8
 
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -218,6 +299,8 @@ bool test_cobs_encode_255_bytes_no_null(void) // Wikipedia Example 9
 
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -242,6 +325,8 @@ bool test_cobs_encode_254_bytes_trailing_null(void) // Wikipedia Example 10
 
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
 	return true;
 }
 
@@ -267,9 +352,1483 @@ bool test_cobs_encode_254_bytes_trailing_null_one(void) // Wikipedia Example 11
 
 	FWD_TEST;
 	REV_TEST;
+	INPLACE_FWD_TEST;
+	INPLACE_REV_TEST;
+	return true;
+}
+
+// Longer frames push the encoder through its wide (SIMD / SWAR) kernels, including the 254 byte
+// block limit landing on and around vector boundaries. Checked against a plain byte-at-a-time encoder.
+#define LONG_TEST_SIZE 1200
+
+static size_t reference_encode(const uint8_t *input, size_t length, uint8_t *output)
+{
+	size_t code_index = 0, write_index = 1;
+	uint8_t code = 1;
+	bool closed_by_ff = false;
+	for (size_t i = 0; i < length; i++)
+	{
+		closed_by_ff = false;
+		if (input[i] != 0)
+		{
+			output[write_index++] = input[i];
+			if (++code != 0xFF) continue;
+			closed_by_ff = true;
+		}
+		output[code_index] = code;
+		code_index = write_index++;
+		code = 1;
+	}
+	if (!closed_by_ff)
+	{
+		output[code_index] = code;
+		code_index = write_index;
+	}
+	return code_index;
+}
+
+static uint32_t test_rand_state = 12345;
+static uint8_t test_rand_byte(unsigned zero_one_in)
+{
+	test_rand_state = test_rand_state * 1103515245u + 12345u;
+	uint8_t b = (uint8_t)(test_rand_state >> 16);
+	if (zero_one_in == 0) return b | 1;
+	return ((test_rand_state >> 8) % zero_one_in == 0) ? 0 : (b | 1);
+}
+
+bool test_cobs_encode_long_random(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 700, 255, 60, 4, 1 };
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	static uint8_t encoded[sizeof(expected) + 64];
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t length = 0; length <= LONG_TEST_SIZE; length += (length < 600 ? 1 : 37))
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			size_t expected_length = reference_encode(test_data, length, expected);
+			memset(encoded, MARKER_BYTE, sizeof(encoded));
+			size_t encoded_length = cobs_encode(test_data, length, encoded);
+#ifdef COBS_ENCODE_ADD_TERMINATOR
+			ASSERT_EQUAL_LUINT(encoded_length, expected_length + 1);
+			ASSERT_EQUAL_LUINT(encoded[expected_length], 0);
+#else
+			ASSERT_EQUAL_LUINT(encoded_length, expected_length);
+#endif
+			ASSERT_EQUAL_MEM("FWD", encoded, expected, expected_length);
+			for (size_t i = encoded_length; i < sizeof(encoded); i++)
+			{
+				if (encoded[i] != MARKER_BYTE)
+				{
+					printf("Failed: encoding overwrote buffer at pos %lu in %s\n", (unsigned long)i, __func__);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// The same frames decoded again, plus a copy of each with one byte knocked to NULL or bumped up,
+// which must be rejected (or accepted) exactly when a byte-at-a-time decoder would.
+static size_t reference_decode(const uint8_t *input, size_t length, uint8_t *output)
+{
+	size_t read_index = 0, write_index = 0;
+	while (read_index < length)
+	{
+		uint8_t code = input[read_index++];
+		if (code == 0 || read_index + code - 1 > length) return 0;
+		for (uint8_t i = 1; i < code; i++)
+		{
+			if (input[read_index] == 0) return 0;
+			output[write_index++] = input[read_index++];
+		}
+		if (code != 0xFF && read_index != length) output[write_index++] = 0;
+	}
+	return write_index;
+}
+
+bool test_cobs_decode_long_random(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 700, 255, 60, 4, 1 };
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t encoded[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	static uint8_t expected[sizeof(encoded)];
+	static uint8_t decoded[sizeof(encoded) + 64];
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t length = 0; length <= LONG_TEST_SIZE; length += (length < 600 ? 1 : 37))
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			size_t encoded_length = reference_encode(test_data, length, encoded);
+			memset(decoded, MARKER_BYTE, sizeof(decoded));
+			size_t decoded_length = cobs_decode(encoded, encoded_length, decoded);
+			ASSERT_EQUAL_LUINT(decoded_length, length);
+			ASSERT_EQUAL_MEM("REV", decoded, test_data, length);
+			for (size_t i = length; i < sizeof(decoded); i++)
+			{
+				if (decoded[i] != MARKER_BYTE)
+				{
+					printf("Failed: decoding overwrote buffer at pos %lu in %s\n", (unsigned long)i, __func__);
+					return false;
+				}
+			}
+
+			size_t pos = test_rand_state % encoded_length;
+			encoded[pos] = (test_rand_state & 0x100) ? 0 : (uint8_t)(encoded[pos] + 1 + (test_rand_state >> 24) % 8);
+			size_t expected_length = reference_decode(encoded, encoded_length, expected);
+			decoded_length = cobs_decode(encoded, encoded_length, decoded);
+			ASSERT_EQUAL_LUINT(decoded_length, expected_length);
+			ASSERT_EQUAL_MEM("REV", decoded, expected, expected_length);
+		}
+	}
+	return true;
+}
+
+#ifndef COBS_TEST_CORE_ONLY
+// Everything from here to the matching #endif exercises API beyond cobs_encode / cobs_decode, so
+// it is left out (-DCOBS_TEST_CORE_ONLY) when the suite is built against the Jacques F version.
+
+bool test_cobs_encoder_chunks(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 700, 255, 4, 1 };
+	static const size_t max_chunks[] = { 1, 7, 254, 255, 600 };
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	static uint8_t streamed[COBS_ENCODER_UPDATE_BOUND(LONG_TEST_SIZE) + 256];
+	cobs_encoder enc;
+	cobs_encoder_init(&enc);
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t c = 0; c < sizeof(max_chunks) / sizeof(max_chunks[0]); c++)
+		{
+			for (size_t length = 0; length <= LONG_TEST_SIZE; length += 53)
+			{
+				for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+				size_t expected_length = cobs_encode(test_data, length, expected);
+				size_t streamed_length = 0;
+				for (size_t pos = 0; pos < length; )
+				{
+					test_rand_byte(0);
+					size_t chunk = 1 + (test_rand_state >> 8) % max_chunks[c];
+					if (chunk > length - pos) chunk = length - pos;
+					streamed_length += cobs_encoder_update(&enc, test_data + pos, chunk, streamed + streamed_length);
+					pos += chunk;
+				}
+				streamed_length += cobs_encoder_finish(&enc, streamed + streamed_length, COBS_ENCODE_TERMINATES);
+				ASSERT_EQUAL_LUINT(streamed_length, expected_length);
+				ASSERT_EQUAL_MEM("FWD", streamed, expected, expected_length);
+			}
+		}
+	}
+	return true;
+}
+
+// The payload cut into up to 8 segments, some empty, some a few bytes around a 254 byte block boundary.
+bool test_cobs_encodev_segments(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 255, 4, 1 };
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	static uint8_t encoded[sizeof(expected) + 64];
+	struct iovec iov[8];
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t length = 0; length <= LONG_TEST_SIZE; length += 13)
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			size_t expected_length = cobs_encode(test_data, length, expected);
+			int iovcnt = 0;
+			for (size_t pos = 0; iovcnt < 8; iovcnt++)
+			{
+				test_rand_byte(0);
+				size_t cut = (test_rand_state >> 8) % 4 == 0 ? 254 + (test_rand_state >> 12) % 5 - 2 : (test_rand_state >> 12) % 300;
+				if (iovcnt == 7 || cut > length - pos) cut = length - pos;
+				iov[iovcnt].iov_base = test_data + pos;
+				iov[iovcnt].iov_len = cut;
+				pos += cut;
+			}
+			memset(encoded, MARKER_BYTE, sizeof(encoded));
+			ASSERT_EQUAL_LUINT(cobs_encodev(iov, iovcnt, encoded), expected_length);
+			ASSERT_EQUAL_MEM("FWD", encoded, expected, expected_length);
+			ASSERT_EQUAL_LUINT(encoded[expected_length], MARKER_BYTE);
+		}
+	}
+	return true;
+}
+
+// Multi-megabyte payloads, split across 4 threads: random, NULL free, and NULL free apart from a few
+// NULLs placed so that chunk boundaries land on and around them.
+bool test_cobs_encode_parallel(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 1, 300, 200000 };
+	const size_t length = 3 * COBS_PARALLEL_THRESHOLD + 12345;
+	uint8_t *test_data = malloc(length);
+	uint8_t *expected = malloc(length + length / 254 + 2);
+	uint8_t *encoded = malloc(length + length / 254 + 2 + 64);
+	cobs_pool *pool = cobs_pool_create(4);
+	bool ok = test_data && expected && encoded && pool;
+	for (size_t d = 0; ok && d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t variant = 0; ok && variant < 3; variant++)
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			if (variant == 1) test_data[length / 2] = test_data[length / 4 - 1] = 0;
+			if (variant == 2) test_data[length / 3 - 254] = 0;
+			size_t expected_length = cobs_encode(test_data, length, expected);
+			memset(encoded, MARKER_BYTE, length + length / 254 + 2 + 64);
+			size_t encoded_length = cobs_encode_parallel(pool, test_data, length, encoded);
+			if (encoded_length != expected_length || memcmp(encoded, expected, expected_length) != 0 ||
+				encoded[expected_length] != MARKER_BYTE)
+			{
+				printf("%30s: Failed, density %u variant %lu\n", __func__, densities[d], (unsigned long)variant);
+				ok = false;
+			}
+		}
+	}
+	cobs_pool_destroy(pool);
+	free(test_data);
+	free(expected);
+	free(encoded);
+	return ok;
+}
+
+#define RX_FRAMES 300
+#define RX_CAPACITY 700
+#define RX_MAX_PAYLOAD (RX_CAPACITY + 50)
+
+static uint8_t rx_payloads[RX_FRAMES * RX_MAX_PAYLOAD];
+static size_t rx_lengths[RX_FRAMES];
+static size_t rx_encoded_lengths[RX_FRAMES];
+static cobs_status rx_statuses[RX_FRAMES];
+static uint8_t rx_stream[RX_FRAMES * (RX_MAX_PAYLOAD + 10)];
+static size_t rx_stream_length = 0;
+
+// frames of 0 to 749 bytes, one in seven with a header pointing past its end, separated by 1 to 3 NULLs
+static void build_rx_stream(void)
+{
+	if (rx_stream_length) return;
+	for (size_t f = 0; f < RX_FRAMES; f++)
+	{
+		uint8_t *payload = rx_payloads + f * RX_MAX_PAYLOAD;
+		rx_lengths[f] = test_rand_byte(0) * RX_MAX_PAYLOAD / 256;
+		unsigned density = test_rand_byte(0) % 8;
+		for (size_t i = 0; i < rx_lengths[f]; i++) payload[i] = test_rand_byte(density);
+		size_t encoded_length = reference_encode(payload, rx_lengths[f], rx_stream + rx_stream_length);
+		rx_statuses[f] = COBS_OK;
+		if (f % 7 == 3 && encoded_length < 255)
+		{
+			rx_stream[rx_stream_length] = 0xFF; // header now points past the end of the frame
+			rx_statuses[f] = COBS_ERR_OVERRUN;
+		}
+		rx_encoded_lengths[f] = encoded_length;
+		rx_stream_length += encoded_length;
+		for (unsigned i = 0; i <= f % 3; i++) rx_stream[rx_stream_length++] = 0;
+	}
+}
+
+static size_t rx_chunk(size_t max_chunk, size_t left)
+{
+	test_rand_byte(0);
+	size_t chunk = 1 + (test_rand_state >> 8) % max_chunk;
+	return chunk < left ? chunk : left;
+}
+
+// The length pre-pass and the runtime terminator choice agree with cobs_encode.
+bool test_cobs_encoded_length(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 255, 4, 1 };
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	static uint8_t encoded[sizeof(expected) + 64];
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t length = 0; length <= LONG_TEST_SIZE; length += 3)
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			size_t expected_length = cobs_encode(test_data, length, expected);
+			ASSERT_EQUAL_LUINT(cobs_encoded_length(test_data, length), expected_length);
+			if (COBS_ENCODE_TERMINATES) expected_length--;
+			memset(encoded, MARKER_BYTE, sizeof(encoded));
+			ASSERT_EQUAL_LUINT(cobs_encode_frame(test_data, length, encoded, false), expected_length);
+			ASSERT_EQUAL_MEM("FWD", encoded, expected, expected_length);
+			ASSERT_EQUAL_LUINT(encoded[expected_length], MARKER_BYTE);
+			ASSERT_EQUAL_LUINT(cobs_encode_frame(test_data, length, encoded, true), expected_length + 1);
+			ASSERT_EQUAL_LUINT(encoded[expected_length], 0);
+		}
+	}
+	return true;
+}
+
+// Every delimiter round trips: the frame is cobs_encode_frame's XORed with it, holds no delimiter byte,
+// and a delimiter planted inside it makes the decoder give up, just as a NULL does.
+bool test_cobs_delim_all_values(void)
+{
+	SETUP_TEST;
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	static uint8_t encoded[sizeof(expected) + 64];
+	static uint8_t decoded[sizeof(expected) + 64];
+	for (unsigned d = 0; d <= 0xFF; d++)
+	{
+		uint8_t delimiter = (uint8_t)d;
+		for (size_t length = d % 5; length <= LONG_TEST_SIZE; length += 61 + d % 7)
+		{
+			unsigned density = (length / 61) % 5;
+			for (size_t i = 0; i < length; i++)
+			{
+				test_data[i] = test_rand_byte(density == 4 ? 0 : density * 2);
+				if (density == 3 && i % 5 == 0) test_data[i] = delimiter;
+			}
+			size_t expected_length = cobs_encode_frame(test_data, length, expected, false);
+			memset(encoded, MARKER_BYTE, sizeof(encoded));
+			ASSERT_EQUAL_LUINT(cobs_encode_delim(test_data, length, encoded, delimiter, false), expected_length);
+			for (size_t n = 0; n < expected_length; n++)
+			{
+				if ((encoded[n] ^ delimiter) != expected[n] || encoded[n] == delimiter)
+				{
+					printf("%30s: Failed, delimiter 0x%02X length %lu byte %lu\n", __func__, d, (unsigned long)length, (unsigned long)n);
+					return false;
+				}
+			}
+			ASSERT_EQUAL_LUINT(encoded[expected_length], MARKER_BYTE);
+			ASSERT_EQUAL_LUINT(cobs_encode_delim(test_data, length, encoded, delimiter, true), expected_length + 1);
+			ASSERT_EQUAL_LUINT(encoded[expected_length], delimiter);
+
+			memset(decoded, MARKER_BYTE, sizeof(decoded));
+			size_t decoded_length = cobs_decode_delim(encoded, expected_length, decoded, delimiter);
+			if (length) ASSERT_EQUAL_LUINT(decoded_length, length);
+			ASSERT_EQUAL_MEM("REV", decoded, test_data, length);
+			ASSERT_EQUAL_LUINT(decoded[length], MARKER_BYTE);
+			if (expected_length > 2)
+			{
+				encoded[expected_length / 2] = delimiter;
+				ASSERT_EQUAL_LUINT(cobs_decode_delim(encoded, expected_length, decoded, delimiter), 0);
+			}
+		}
+	}
+	return true;
+}
+
+// COBS/R: the wikipedia style vectors that change, and some that must not, then random frames checked
+// against the plain encoding with its last block reduced by hand. Neither direction may write past the
+// frame, and a NULL anywhere in a reduced frame must still be rejected.
+static bool check_reduced(const char *name, const uint8_t *test_data, size_t length, const uint8_t *expected, size_t expected_length)
+{
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));
+	size_t encoded_length = cobs_encode_reduced(test_data, length, working_buffer, false);
+	ASSERT_EQUAL_LUINT(encoded_length, expected_length);
+	ASSERT_EQUAL_MEM(name, working_buffer, expected, expected_length);
+	for (size_t n = expected_length; n < MAX_TEST_SIZE; n++)
+	{
+		if (working_buffer[n] != MARKER_BYTE)
+		{
+			printf("Failed: reduced encoding overwrote buffer at pos %lu in %s\n", (unsigned long)n, name);
+			return false;
+		}
+	}
+	ASSERT_EQUAL_LUINT(cobs_encode_reduced(test_data, length, working_buffer, true), expected_length + 1);
+	ASSERT_EQUAL_LUINT(working_buffer[expected_length], 0);
+
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));
+	size_t decoded_length = cobs_decode_reduced(expected, expected_length, working_buffer);
+	if (length) ASSERT_EQUAL_LUINT(decoded_length, length);
+	ASSERT_EQUAL_MEM(name, working_buffer, test_data, length);
+	for (size_t n = length; n < MAX_TEST_SIZE; n++)
+	{
+		if (working_buffer[n] != MARKER_BYTE)
+		{
+			printf("Failed: reduced decoding overwrote buffer at pos %lu in %s\n", (unsigned long)n, name);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool test_cobs_reduced(void)
+{
+	SETUP_TEST;
+	static const struct
+	{
+		uint8_t data[6], length;
+		uint8_t expected[6], expected_length;
+	} vectors[] = {
+		{ { 0 }, 0, { 0x01 }, 1 },
+		{ { 0x00 }, 1, { 0x01, 0x01 }, 2 },
+		{ { 0x01 }, 1, { 0x02, 0x01 }, 2 },
+		{ { 0x02 }, 1, { 0x02 }, 1 },
+		{ { 0x05 }, 1, { 0x05 }, 1 },
+		{ { 0x11, 0x22, 0x33, 0x44 }, 4, { 0x44, 0x11, 0x22, 0x33 }, 4 },
+		{ { 0x11, 0x22, 0x33, 0x04 }, 4, { 0x05, 0x11, 0x22, 0x33, 0x04 }, 5 },
+		{ { 0x11, 0x22, 0x33, 0x05 }, 4, { 0x05, 0x11, 0x22, 0x33 }, 4 },
+		{ { 0x12, 0x00, 0x34 }, 3, { 0x02, 0x12, 0x34 }, 3 },
+		{ { 0x11, 0x00, 0x00, 0x00 }, 4, { 0x02, 0x11, 0x01, 0x01, 0x01 }, 5 },
+	};
+	for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++)
+	{
+		if (!check_reduced(__func__, vectors[v].data, vectors[v].length, vectors[v].expected, vectors[v].expected_length)) return false;
+	}
+
+	// wikipedia example 7 keeps its code byte (0xFE < 0xFF); shifted up by one, the 0xFF replaces it
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	for (size_t i = 0; i < 254; i++) test_data[i] = (uint8_t)(i + 1);
+	size_t expected_length = reference_encode(test_data, 254, expected);
+	if (!check_reduced(__func__, test_data, 254, expected, expected_length)) return false;
+	for (size_t i = 0; i < 254; i++) test_data[i] = (uint8_t)(i + 2);
+	expected[0] = 0xFF;
+	for (size_t i = 1; i < 254; i++) expected[i] = (uint8_t)(i + 1);
+	if (!check_reduced(__func__, test_data, 254, expected, 254)) return false;
+
+	static uint8_t encoded[sizeof(expected) + 64];
+	static uint8_t decoded[sizeof(expected) + 64];
+	for (size_t length = 0; length <= LONG_TEST_SIZE; length += (length < 300 ? 1 : 23))
+	{
+		unsigned density = length % 5;
+		for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(density == 4 ? 0 : density * 3);
+		size_t plain_length = reference_encode(test_data, length, expected);
+		size_t run = 0;
+		while (run < length && test_data[length - 1 - run] != 0) run++;
+		size_t last = run == 0 ? 0 : (run - 1) % 254 + 1;          // data bytes in the last block
+		size_t expected_length = plain_length;
+		if (last && test_data[length - 1] >= last + 1)
+		{
+			expected[plain_length - 1 - last] = test_data[length - 1];
+			expected_length--;
+		}
+		memset(encoded, MARKER_BYTE, sizeof(encoded));
+		ASSERT_EQUAL_LUINT(cobs_encode_reduced(test_data, length, encoded, false), expected_length);
+		ASSERT_EQUAL_MEM("FWD", encoded, expected, expected_length);
+		ASSERT_EQUAL_LUINT(encoded[expected_length], MARKER_BYTE);
+
+		memset(decoded, MARKER_BYTE, sizeof(decoded));
+		size_t decoded_length = cobs_decode_reduced(encoded, expected_length, decoded);
+		if (length) ASSERT_EQUAL_LUINT(decoded_length, length);
+		ASSERT_EQUAL_MEM("REV", decoded, test_data, length);
+		ASSERT_EQUAL_LUINT(decoded[length], MARKER_BYTE);
+		if (expected_length > 1)
+		{
+			encoded[length % expected_length] = 0;
+			ASSERT_EQUAL_LUINT(cobs_decode_reduced(encoded, expected_length, decoded), 0);
+		}
+	}
+	return true;
+}
+
+// COBS/ZPE: hand worked vectors for each kind of block, including NULL pairs made with the NULL the
+// payload is taken to end with, then random payloads from NULL free to all NULL through a round trip.
+static bool check_zpe(const char *name, const uint8_t *test_data, size_t length, const uint8_t *expected, size_t expected_length)
+{
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));
+	ASSERT_EQUAL_LUINT(cobs_zpe_encode(test_data, length, working_buffer), expected_length);
+	ASSERT_EQUAL_MEM(name, working_buffer, expected, expected_length);
+	for (size_t n = expected_length; n < MAX_TEST_SIZE; n++)
+	{
+		if (working_buffer[n] != MARKER_BYTE)
+		{
+			printf("Failed: ZPE encoding overwrote buffer at pos %lu in %s\n", (unsigned long)n, name);
+			return false;
+		}
+	}
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));
+	size_t decoded_length = cobs_zpe_decode(expected, expected_length, working_buffer);
+	if (length) ASSERT_EQUAL_LUINT(decoded_length, length);
+	ASSERT_EQUAL_MEM(name, working_buffer, test_data, length);
+	for (size_t n = length; n < MAX_TEST_SIZE; n++)
+	{
+		if (working_buffer[n] != MARKER_BYTE)
+		{
+			printf("Failed: ZPE decoding overwrote buffer at pos %lu in %s\n", (unsigned long)n, name);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool test_cobs_zpe(void)
+{
+	SETUP_TEST;
+	static const struct
+	{
+		uint8_t data[8], length;
+		uint8_t expected[8], expected_length;
+	} vectors[] = {
+		{ { 0 }, 0, { 0x01 }, 1 },
+		{ { 0x00 }, 1, { 0xE0 }, 1 },
+		{ { 0x00, 0x00 }, 2, { 0xE0, 0x01 }, 2 },
+		{ { 0x00, 0x00, 0x00 }, 3, { 0xE0, 0xE0 }, 2 },
+		{ { 0x11, 0x22, 0x33, 0x44 }, 4, { 0x05, 0x11, 0x22, 0x33, 0x44 }, 5 },
+		{ { 0x11, 0x00, 0x22 }, 3, { 0x02, 0x11, 0x02, 0x22 }, 4 },
+		{ { 0x11, 0x22, 0x00, 0x00, 0x33 }, 5, { 0xE2, 0x11, 0x22, 0x02, 0x33 }, 5 },
+		{ { 0x11, 0x00, 0x00, 0x00 }, 4, { 0xE1, 0x11, 0xE0 }, 3 },
+		{ { 0x11, 0x00, 0x00, 0x00, 0x00 }, 5, { 0xE1, 0x11, 0xE0, 0x01 }, 4 },
+	};
+	for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++)
+	{
+		if (!check_zpe(__func__, vectors[v].data, vectors[v].length, vectors[v].expected, vectors[v].expected_length)) return false;
+	}
+
+	// a pair after a 32 byte run is too long for one code; 222 byte runs with and without a NULL after them
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 222 + 2];
+	for (size_t i = 0; i < 32; i++) test_data[i] = expected[i + 1] = (uint8_t)(i + 1);
+	test_data[32] = test_data[33] = 0;
+	expected[0] = 0x21;
+	expected[33] = 0xE0;
+	if (!check_zpe(__func__, test_data, 34, expected, 34)) return false;
+	for (size_t i = 0; i < 223; i++) test_data[i] = expected[i + 1] = (uint8_t)(i % 255 + 1);
+	expected[0] = 0xDF;
+	if (!check_zpe(__func__, test_data, 222, expected, 223)) return false;
+	expected[223] = 0x02;
+	expected[224] = test_data[222];
+	if (!check_zpe(__func__, test_data, 223, expected, 225)) return false;
+	test_data[222] = 0;
+	expected[223] = 0xE0;
+	if (!check_zpe(__func__, test_data, 223, expected, 224)) return false;
+
+	static const unsigned densities[] = { 0, 255, 20, 4, 2, 1 };
+	static uint8_t encoded[sizeof(expected) + 64];
+	static uint8_t decoded[2 * sizeof(encoded)];
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t length = 0; length <= LONG_TEST_SIZE; length += (length < 300 ? 1 : 29))
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			memset(encoded, MARKER_BYTE, sizeof(encoded));
+			size_t encoded_length = cobs_zpe_encode(test_data, length, encoded);
+			if (encoded_length > COBS_ZPE_ENCODE_MAX_LENGTH(length) || memchr(encoded, 0, encoded_length))
+			{
+				printf("%30s: Failed, bad encoding of %lu bytes at density %u\n", __func__, (unsigned long)length, densities[d]);
+				return false;
+			}
+			ASSERT_EQUAL_LUINT(encoded[encoded_length], MARKER_BYTE);
+
+			memset(decoded, MARKER_BYTE, sizeof(decoded));
+			size_t decoded_length = cobs_zpe_decode(encoded, encoded_length, decoded);
+			if (length) ASSERT_EQUAL_LUINT(decoded_length, length);
+			ASSERT_EQUAL_MEM("REV", decoded, test_data, length);
+			ASSERT_EQUAL_LUINT(decoded[length], MARKER_BYTE);
+			if (encoded_length > 1)
+			{
+				encoded[length % encoded_length] = 0;
+				ASSERT_EQUAL_LUINT(cobs_zpe_decode(encoded, encoded_length, decoded), 0);
+			}
+		}
+	}
+	return true;
+}
+
+// The CRCs against their published check values (whole, and split across calls so the 8 byte loops and the
+// byte tails meet), then frames encoded with the CRC appended against cobs_encode_frame of the payload and
+// its CRC put together by hand. Decoding has to give the payload back, and tell a flipped byte (bad CRC)
+// apart from a NULL in the frame (bad framing).
+bool test_cobs_crc(void)
+{
+	SETUP_TEST;
+	static const uint8_t check[] = "123456789123456789";
+	ASSERT_EQUAL_LUINT(cobs_crc16_ccitt(COBS_CRC16_INIT, check, 9), 0x29B1);
+	ASSERT_EQUAL_LUINT(cobs_crc32c(0, check, 9), 0xE3069283);
+	for (size_t split = 0; split <= 18; split++)
+	{
+		ASSERT_EQUAL_LUINT(cobs_crc16_ccitt(cobs_crc16_ccitt(COBS_CRC16_INIT, check, split), check + split, 18 - split),
+		                   cobs_crc16_ccitt(COBS_CRC16_INIT, check, 18));
+		ASSERT_EQUAL_LUINT(cobs_crc32c(cobs_crc32c(0, check, split), check + split, 18 - split), cobs_crc32c(0, check, 18));
+	}
+
+	static const unsigned densities[] = { 0, 255, 4, 1 };
+	static uint8_t test_data[LONG_TEST_SIZE + 4];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 8];
+	static uint8_t encoded[sizeof(expected) + 64];
+	static uint8_t decoded[sizeof(expected) + 64];
+	for (int kind = COBS_CRC16_CCITT; kind <= COBS_CRC32C; kind++)
+	{
+		size_t width = COBS_CRC_SIZE(kind);
+		for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+		{
+			for (size_t length = 0; length <= LONG_TEST_SIZE; length += (length < 300 ? 1 : 31))
+			{
+				for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+				uint32_t crc = kind == COBS_CRC32C ? cobs_crc32c(0, test_data, length) : cobs_crc16_ccitt(COBS_CRC16_INIT, test_data, length);
+				for (size_t k = 0; k < width; k++)
+				{
+					test_data[length + k] = (uint8_t)(kind == COBS_CRC32C ? crc >> (8 * k) : crc >> (8 * (1 - k)));
+				}
+				size_t expected_length = cobs_encode_frame(test_data, length + width, expected, false);
+
+				uint32_t encode_crc = 0;
+				memset(encoded, MARKER_BYTE, sizeof(encoded));
+				ASSERT_EQUAL_LUINT(cobs_encode_crc(test_data, length, encoded, kind, true, true, &encode_crc), expected_length + 1);
+				ASSERT_EQUAL_LUINT(encode_crc, crc);
+				ASSERT_EQUAL_MEM("FWD", encoded, expected, expected_length);
+				ASSERT_EQUAL_LUINT(encoded[expected_length], 0);
+				ASSERT_EQUAL_LUINT(encoded[expected_length + 1], MARKER_BYTE);
+				ASSERT_EQUAL_LUINT(cobs_encode_crc(test_data, length, encoded, kind, false, false, NULL),
+				                   cobs_encode_frame(test_data, length, decoded, false));
+
+				size_t decoded_length = 1;
+				uint32_t decode_crc = 0;
+				memset(decoded, MARKER_BYTE, sizeof(decoded));
+				ASSERT_EQUAL_LUINT(cobs_decode_crc(expected, expected_length, decoded, kind, true, &decoded_length, &decode_crc), COBS_OK);
+				ASSERT_EQUAL_LUINT(decoded_length, length);
+				ASSERT_EQUAL_LUINT(decode_crc, crc);
+				ASSERT_EQUAL_MEM("REV", decoded, test_data, length);
+				ASSERT_EQUAL_LUINT(decoded[length + width], MARKER_BYTE);
+				ASSERT_EQUAL_LUINT(cobs_decode_crc(expected, expected_length, decoded, kind, false, &decoded_length, NULL), COBS_OK);
+				ASSERT_EQUAL_LUINT(decoded_length, length + width);
+
+				size_t at = 1 + length % (expected_length - 1);
+				uint8_t saved = expected[at];
+				expected[at] = saved == 0xFF ? 0xFE : saved + 1;
+				cobs_status status = cobs_decode_crc(expected, expected_length, decoded, kind, true, &decoded_length, NULL);
+				if (status != COBS_ERR_CRC && status != COBS_ERR_OVERRUN)   // a bumped code byte may break the framing
+				{
+					printf("%30s: Failed, corrupt frame of %lu bytes gave status %d\n", __func__, (unsigned long)length, (int)status);
+					return false;
+				}
+				ASSERT_EQUAL_LUINT(decoded_length, 0);
+				expected[at] = 0;
+				ASSERT_EQUAL_LUINT(cobs_decode_crc(expected, expected_length, decoded, kind, true, &decoded_length, NULL), COBS_ERR_OVERRUN);
+			}
+		}
+		// a valid frame too short to hold a CRC
+		ASSERT_EQUAL_LUINT(cobs_decode_crc((const uint8_t *)"\x02\x11", 2, decoded, kind, true, &(size_t){ 0 }, NULL), COBS_ERR_CRC);
+	}
+	return true;
+}
+
+// Long payloads with the minimum headroom, where 254 byte blocks eat into it the most.
+bool test_cobs_encode_inplace_long(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 255, 4, 1 };
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	static uint8_t buffer[sizeof(expected) + 64];
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t length = 0; length <= LONG_TEST_SIZE; length += 11)
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			size_t expected_length = cobs_encode(test_data, length, expected);
+			size_t headroom = COBS_ENCODE_HEADROOM(length);
+			memset(buffer, MARKER_BYTE, sizeof(buffer));
+			memcpy(buffer + headroom, test_data, length);
+			ASSERT_EQUAL_LUINT(cobs_encode_inplace(buffer, headroom, length), expected_length);
+			ASSERT_EQUAL_MEM("INPLACE FWD", buffer, expected, expected_length);
+			size_t end = headroom + length > expected_length ? headroom + length : expected_length;
+			ASSERT_EQUAL_LUINT(buffer[end], MARKER_BYTE);
+			if (length) ASSERT_EQUAL_LUINT(cobs_encode_inplace(buffer, headroom - 1, length), 0);
+		}
+	}
+	return true;
+}
+
+// Frames written into a small ring from every kind of head position, so that the wrap falls in the middle
+// of a run, right after a code byte and right before one. Read back from head, the ring must hold exactly
+// what cobs_encode_frame gives; everything outside the frame must be untouched; and a frame one byte too
+// big for the free space must be refused without writing anything.
+bool test_cobs_encode_ring(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 255, 4 };
+	static uint8_t test_data[600];
+	static uint8_t expected[COBS_ENCODE_MAX_LENGTH(600)];
+	static uint8_t ring[613];
+	const size_t capacity = sizeof(ring);
+	for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+	{
+		for (size_t length = 0; length <= sizeof(test_data); length += (length < 40 ? 1 : 17))
+		{
+			for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(densities[d]);
+			for (int terminate = 0; terminate <= 1; terminate++)
+			{
+				size_t expected_length = cobs_encode_frame(test_data, length, expected, terminate);
+				for (size_t head = 0; head < capacity; head += (head < 8 || capacity - head < 300 ? 1 : 97))
+				{
+					memset(ring, MARKER_BYTE, capacity);
+					ASSERT_EQUAL_LUINT(cobs_encode_ring(test_data, length, ring, capacity, head, expected_length - 1, terminate), COBS_RING_FULL);
+					for (size_t n = 0; n < capacity; n++) ASSERT_EQUAL_LUINT(ring[n], MARKER_BYTE);
+
+					size_t free_bytes = (head + length) % 3 ? capacity : expected_length;
+					size_t new_head = cobs_encode_ring(test_data, length, ring, capacity, head, free_bytes, terminate);
+					ASSERT_EQUAL_LUINT(new_head, (head + expected_length) % capacity);
+					for (size_t n = 0; n < capacity; n++)
+					{
+						size_t offset = (n + capacity - head) % capacity;
+						uint8_t want = offset < expected_length ? expected[offset] : MARKER_BYTE;
+						if (ring[n] != want)
+						{
+							printf("%30s: Failed, length %lu head %lu: ring[%lu] = 0x%02X, expected 0x%02X\n", __func__,
+							       (unsigned long)length, (unsigned long)head, (unsigned long)n, ring[n], want);
+							return false;
+						}
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// A stream of frames, some of them broken, fed to the receiver in chunks from 1 byte to 64KB.
+typedef struct
+{
+	size_t frame;
+	bool failed;
+	const size_t *sizes;		// frames with sizes[f] > limit are expected to overflow
+	size_t limit;
+} rx_check;
+
+static void rx_handler(void *context, cobs_status status, const uint8_t *frame, size_t length)
+{
+	rx_check *check = context;
+	size_t f = check->frame++;
+	if (check->failed) return;
+	if (f >= RX_FRAMES)
+	{
+		printf("%30s: Failed, more frames than were sent\n", "rx_handler");
+		check->failed = true;
+		return;
+	}
+	cobs_status expected = check->sizes[f] > check->limit ? COBS_ERR_OVERFLOW : rx_statuses[f];
+	if (status != expected ||
+		(status == COBS_OK && (length != rx_lengths[f] || memcmp(frame, rx_payloads + f * RX_MAX_PAYLOAD, length) != 0)))
+	{
+		printf("%30s: Failed, frame %lu: status %d length %lu\n", "rx_handler", (unsigned long)f, (int)status, (unsigned long)length);
+		check->failed = true;
+	}
+}
+
+bool test_cobs_receiver_chunks(void)
+{
+	SETUP_TEST;
+	static const size_t max_chunks[] = { 1, 3, 300, 4096, 65536 };
+	static uint8_t rx_buffer[RX_CAPACITY];
+	build_rx_stream();
+
+	cobs_receiver rx;
+	for (size_t c = 0; c < sizeof(max_chunks) / sizeof(max_chunks[0]); c++)
+	{
+		rx_check check = { 0, false, rx_lengths, RX_CAPACITY };
+		cobs_receiver_init(&rx, rx_buffer, sizeof(rx_buffer));
+		for (size_t pos = 0; pos < rx_stream_length; )
+		{
+			size_t chunk = rx_chunk(max_chunks[c], rx_stream_length - pos);
+			cobs_receiver_process(&rx, rx_stream + pos, chunk, rx_handler, &check);
+			pos += chunk;
+		}
+		if (check.failed) return false;
+		ASSERT_EQUAL_LUINT(check.frame, RX_FRAMES);
+	}
+	return true;
+}
+
+// The same stream read into a gateway style receive buffer, unused bytes carried over to the next read.
+bool test_cobs_decode_batch(void)
+{
+	SETUP_TEST;
+	static const size_t max_chunks[] = { 1, 300, 4096, 65536 };
+	static uint8_t rx_buffer[sizeof(rx_stream)];
+	static uint8_t arena[sizeof(rx_stream)];
+	cobs_frame frames[40];
+	build_rx_stream();
+
+	for (size_t c = 0; c < sizeof(max_chunks) / sizeof(max_chunks[0]); c++)
+	{
+		size_t frame = 0, buffered = 0;
+		for (size_t pos = 0; pos < rx_stream_length; )
+		{
+			size_t chunk = rx_chunk(max_chunks[c], rx_stream_length - pos);
+			memcpy(rx_buffer + buffered, rx_stream + pos, chunk);
+			buffered += chunk;
+			pos += chunk;
+			size_t max_frames = 1 + frame % 40, trailing;
+			size_t count = cobs_decode_batch(rx_buffer, buffered, arena, frames, max_frames, &trailing);
+			for (size_t n = 0; n < count; n++, frame++)
+			{
+				ASSERT_EQUAL_LUINT(frames[n].status, rx_statuses[frame]);
+				if (frames[n].status != COBS_OK) continue;
+				ASSERT_EQUAL_LUINT(frames[n].length, rx_lengths[frame]);
+				ASSERT_EQUAL_MEM("REV", arena + frames[n].offset, rx_payloads + frame * RX_MAX_PAYLOAD, rx_lengths[frame]);
+			}
+			memmove(rx_buffer, rx_buffer + buffered - trailing, trailing);
+			buffered = trailing;
+		}
+		while (buffered > 0 && frame < RX_FRAMES) // frames left over after hitting max_frames
+		{
+			size_t trailing;
+			size_t count = cobs_decode_batch(rx_buffer, buffered, arena, frames, 40, &trailing);
+			for (size_t n = 0; n < count; n++, frame++)
+			{
+				ASSERT_EQUAL_LUINT(frames[n].status, rx_statuses[frame]);
+			}
+			memmove(rx_buffer, rx_buffer + buffered - trailing, trailing);
+			buffered = trailing;
+		}
+		ASSERT_EQUAL_LUINT(frame, RX_FRAMES);
+		ASSERT_EQUAL_LUINT(buffered, 0);
+	}
+	return true;
+}
+
+// Frames encoded into and decoded out of pool buffers match cobs_encode / cobs_decode, take the smallest
+// class their exact encoded length fits, spill into bigger classes, and run out rather than allocate.
+bool test_cobs_frame_pool(void)
+{
+	SETUP_TEST;
+	static const size_t counts[COBS_FRAME_CLASSES] = { 4, 4, 2, 1, 0, 1 };
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t expected[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 2];
+	uint8_t *held[16];
+	cobs_frame_cache cache;
+	cobs_frame_pool *pool = cobs_frame_pool_create(counts);
+	if (pool == NULL) return false;
+	cobs_frame_cache_init(&cache);
+
+	// 64 bytes, no NULLs: 65 or 66 bytes encoded, which still fits the 64 byte payload class
+	for (size_t i = 0; i < 64; i++) test_data[i] = test_rand_byte(0);
+	size_t expected_length = cobs_encode(test_data, 64, expected), encoded_length, decoded_length;
+	uint8_t *frame = cobs_frame_encode(pool, &cache, test_data, 64, &encoded_length);
+	ASSERT_EQUAL_LUINT(encoded_length, expected_length);
+	ASSERT_EQUAL_MEM("FWD", frame, expected, expected_length);
+	ASSERT_EQUAL_LUINT(cobs_frame_capacity(pool, frame) < COBS_ENCODE_MAX_LENGTH(256), true);
+	uint8_t *decoded = cobs_frame_decode(pool, &cache, frame, expected_length - COBS_ENCODE_TERMINATES, &decoded_length);
+	ASSERT_EQUAL_LUINT(decoded_length, 64);
+	ASSERT_EQUAL_MEM("REV", decoded, test_data, 64);
+	cobs_frame_free(pool, &cache, decoded);
+	cobs_frame_free(pool, &cache, frame);
+	ASSERT_EQUAL_LUINT(cobs_frame_decode(pool, &cache, (const uint8_t *)"\x05\x01", 2, &decoded_length) == NULL, true);
+
+	// every buffer can be had once, smallest first, then the pool is dry; class 4 has none and class 3's
+	// only buffer goes to a small frame once the small classes are used up
+	size_t n = 0;
+	while (n < 16 && (held[n] = cobs_frame_alloc(pool, &cache, 10)) != NULL) n++;
+	ASSERT_EQUAL_LUINT(n, 12);
+	for (size_t a = 1; a < n; a++) ASSERT_EQUAL_LUINT(cobs_frame_capacity(pool, held[a]) >= cobs_frame_capacity(pool, held[a - 1]), true);
+	for (size_t a = 0; a < n; a++) memset(held[a], (int)a, cobs_frame_capacity(pool, held[a]));
+	for (size_t a = 0; a < n; a++)
+	{
+		for (size_t b = 0; b < cobs_frame_capacity(pool, held[a]); b++) ASSERT_EQUAL_LUINT(held[a][b], a);
+	}
+	for (size_t a = 0; a < n; a++) cobs_frame_free(pool, a % 2 ? &cache : NULL, held[a]);
+	cobs_frame_cache_flush(pool, &cache);
+	ASSERT_EQUAL_LUINT(cobs_frame_alloc(pool, NULL, COBS_ENCODE_MAX_LENGTH(65536) + 64) == NULL, true);
+	frame = cobs_frame_alloc(pool, NULL, COBS_ENCODE_MAX_LENGTH(65536));
+	ASSERT_EQUAL_LUINT(frame != NULL, true);
+	ASSERT_EQUAL_LUINT(cobs_frame_alloc(pool, NULL, COBS_ENCODE_MAX_LENGTH(65536)) == NULL, true);
+	cobs_frame_free(pool, NULL, frame);
+
+	for (n = 0; n < 16 && (held[n] = cobs_frame_alloc(pool, NULL, 10)) != NULL; n++) ;
+	ASSERT_EQUAL_LUINT(n, 12);
+	cobs_frame_pool_destroy(pool);
 	return true;
 }
 
+// Threads hammering one pool through their own caches never get a buffer another thread holds.
+typedef struct
+{
+	cobs_frame_pool *pool;
+	uint8_t tag;
+	bool failed;
+} pool_thread;
+
+static void *frame_pool_thread(void *arg)
+{
+	pool_thread *t = arg;
+	cobs_frame_cache cache;
+	uint8_t *held[8] = { NULL };
+	uint32_t state = t->tag;
+	cobs_frame_cache_init(&cache);
+	for (unsigned i = 0; i < 20000; i++)
+	{
+		state = state * 1103515245u + 12345u;
+		size_t k = (state >> 16) % 8;
+		if (held[k])
+		{
+			for (size_t b = 0; b < 64; b++) if (held[k][b] != t->tag) t->failed = true;
+			cobs_frame_free(t->pool, &cache, held[k]);
+			held[k] = NULL;
+		}
+		else if ((held[k] = cobs_frame_alloc(t->pool, &cache, (state >> 8) % 2000)) != NULL)
+		{
+			memset(held[k], t->tag, 64);
+		}
+	}
+	for (size_t k = 0; k < 8; k++) cobs_frame_free(t->pool, &cache, held[k]);
+	cobs_frame_cache_flush(t->pool, &cache);
+	return NULL;
+}
+
+bool test_cobs_frame_pool_threads(void)
+{
+	SETUP_TEST;
+	static const size_t counts[COBS_FRAME_CLASSES] = { 40, 40, 40, 0, 0, 0 };
+	pthread_t threads[4];
+	pool_thread t[4];
+	cobs_frame_pool *pool = cobs_frame_pool_create(counts);
+	if (pool == NULL) return false;
+	for (int i = 0; i < 4; i++)
+	{
+		t[i] = (pool_thread){ pool, (uint8_t)(i + 1), false };
+		pthread_create(&threads[i], NULL, frame_pool_thread, &t[i]);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		pthread_join(threads[i], NULL);
+		ASSERT_EQUAL_LUINT(t[i].failed, false);
+	}
+	size_t n = 0;
+	while (cobs_frame_alloc(pool, NULL, 10) != NULL) n++;
+	ASSERT_EQUAL_LUINT(n, 120);
+	cobs_frame_pool_destroy(pool);
+	return true;
+}
+
+// The same stream through the decode pipeline, with slots small enough that some frames overflow them
+// and few enough that the splitter has to wait for the decoders.
+bool test_cobs_pipeline_order(void)
+{
+	SETUP_TEST;
+	static const size_t max_chunks[] = { 1, 300, 65536 };
+	static const size_t slot_bytes[] = { 600, 4096, 65536 };
+	static const size_t depths[] = { 1, 2, 8 };
+	build_rx_stream();
+
+	for (size_t c = 0; c < sizeof(max_chunks) / sizeof(max_chunks[0]); c++)
+	{
+		rx_check check = { 0, false, rx_encoded_lengths, slot_bytes[c] - 1 };
+		cobs_pipeline *pipeline = cobs_pipeline_create(3, slot_bytes[c], depths[c], rx_handler, &check);
+		if (pipeline == NULL)
+		{
+			printf("%30s: Failed, no pipeline\n", __func__);
+			return false;
+		}
+		for (size_t pos = 0; pos < rx_stream_length; )
+		{
+			size_t chunk = rx_chunk(max_chunks[c], rx_stream_length - pos);
+			cobs_pipeline_push(pipeline, rx_stream + pos, chunk);
+			pos += chunk;
+		}
+		cobs_pipeline_flush(pipeline);
+		size_t frames = check.frame;
+		cobs_pipeline_destroy(pipeline);
+		if (check.failed) return false;
+		ASSERT_EQUAL_LUINT(frames, RX_FRAMES);
+	}
+	return true;
+}
+
+// The frame queue on one thread: fill it until reserve refuses, reserving more than is committed and with
+// sizes that make records wrap round the end of the ring at different places, then drain it, peeking each
+// frame twice before releasing it.
+bool test_cobs_queue(void)
+{
+	SETUP_TEST;
+	cobs_queue *queue = cobs_queue_create(500);               // rounds up to 512
+	if (queue == NULL) return false;
+	size_t length = 99;
+	if (cobs_queue_peek(queue, &length) != NULL) return false;
+	ASSERT_EQUAL_LUINT(cobs_queue_reserve(queue, 505) == NULL, true);
+
+	unsigned next = 0;
+	for (int round = 0; round < 50; round++)
+	{
+		unsigned first = next;
+		uint8_t *slot;
+		while ((slot = cobs_queue_reserve(queue, 50 + next % 70)) != NULL)
+		{
+			memset(slot, (int)next + 1, next % 50);
+			cobs_queue_commit(queue, next % 50);
+			next++;
+		}
+		if (next - first < 2)
+		{
+			printf("%30s: Failed, only %u frames fit in round %d\n", __func__, next - first, round);
+			return false;
+		}
+		for (unsigned n = first; n < next; n++)
+		{
+			uint8_t *frame = cobs_queue_peek(queue, &length);
+			if (frame == NULL) return false;
+			ASSERT_EQUAL_LUINT(length, n % 50);
+			if (length) ASSERT_EQUAL_LUINT(frame[0], (uint8_t)(n + 1));
+			if (length) ASSERT_EQUAL_LUINT(frame[length - 1], (uint8_t)(n + 1));
+			ASSERT_EQUAL_LUINT(cobs_queue_peek(queue, &length) == frame, true);
+			cobs_queue_release(queue);
+		}
+		if (cobs_queue_peek(queue, &length) != NULL) return false;
+	}
+
+	// the largest frame that fits (a 256 byte record, half the ring) must be had from a drained queue whatever
+	// the tail offset, even where it has to skip the end of the ring; one byte more never can be
+	for (int offset = 0; offset < 512 / 8; offset++)
+	{
+		ASSERT_EQUAL_LUINT(cobs_queue_reserve(queue, 249) == NULL, true);
+		uint8_t *slot = cobs_queue_reserve(queue, 248);
+		ASSERT_EQUAL_LUINT(slot != NULL, true);
+		if (slot == NULL) return false;
+		memset(slot, offset + 1, 248);
+		cobs_queue_commit(queue, 248);
+		uint8_t *frame = cobs_queue_peek(queue, &length);
+		ASSERT_EQUAL_LUINT(length, 248);
+		ASSERT_EQUAL_LUINT(frame[247], (uint8_t)(offset + 1));
+		cobs_queue_release(queue);
+		cobs_queue_reserve(queue, 0);                           // an empty frame moves the tail on by 8
+		cobs_queue_commit(queue, 0);
+		cobs_queue_peek(queue, &length);
+		cobs_queue_release(queue);
+	}
+	cobs_queue_destroy(queue);
+	return true;
+}
+
+// A producer encoding frames straight into the queue and a consumer decoding them in place, on two
+// threads, with a queue small enough to be full or empty most of the time.
+#define QUEUE_FRAMES 20000
+
+static void queue_payload(uint32_t n, uint8_t *payload, size_t *length)
+{
+	uint32_t state = n * 2654435761u + 1;
+	*length = n % 300;
+	for (size_t i = 0; i < *length; i++)
+	{
+		state = state * 1103515245u + 12345u;
+		payload[i] = (state >> 16) % 5 ? (uint8_t)(state >> 8) : 0;
+	}
+}
+
+static void *queue_producer(void *arg)
+{
+	cobs_queue *queue = arg;
+	uint8_t payload[300];
+	size_t length;
+	for (uint32_t n = 0; n < QUEUE_FRAMES; n++)
+	{
+		queue_payload(n, payload, &length);
+		uint8_t *slot;
+		while ((slot = cobs_queue_reserve(queue, COBS_ENCODE_MAX_LENGTH(length))) == NULL) test_yield();
+		cobs_queue_commit(queue, cobs_encode_frame(payload, length, slot, false));
+	}
+	return NULL;
+}
+
+bool test_cobs_queue_threads(void)
+{
+	SETUP_TEST;
+	cobs_queue *queue = cobs_queue_create(1024);
+	if (queue == NULL) return false;
+	pthread_t producer;
+	pthread_create(&producer, NULL, queue_producer, queue);
+	uint8_t expected[300];
+	size_t expected_length, length;
+	bool failed = false;
+	// every frame is taken, even after a bad one, or the producer would wait for room for ever
+	for (uint32_t n = 0; n < QUEUE_FRAMES; n++)
+	{
+		uint8_t *frame;
+		while ((frame = cobs_queue_peek(queue, &length)) == NULL) test_yield();
+		queue_payload(n, expected, &expected_length);
+		size_t decoded = cobs_decode_inplace(frame, length);
+		bool bad = (expected_length && decoded != expected_length) || memcmp(frame, expected, expected_length) != 0;
+		cobs_queue_release(queue);
+		if (bad && !failed) printf("%30s: Failed, frame %lu\n", __func__, (unsigned long)n);
+		failed |= bad;
+	}
+	pthread_join(producer, NULL);
+	cobs_queue_destroy(queue);
+	return !failed;
+}
+
+#ifdef COBS_TEST_SERVER
+// The frame server against ptys standing in for serial ports: each port's master side is written a stream of
+// frames in chunks of random size, interleaved with the other ports, so frames arrive split across reads and
+// the server has to keep every port's half frame apart. Port 0 starts with a bad frame. Closing the masters
+// must then hang up every port.
+#define SERVER_PORTS 4
+#define SERVER_FRAMES 400
+
+typedef struct
+{
+	uint32_t next[SERVER_PORTS];            // frame each port is due to deliver next
+	unsigned errors, hangups;
+	bool failed;
+} server_check;
+
+static uint32_t server_frame(int port, uint32_t n, uint8_t *payload, size_t *length)
+{
+	do queue_payload(port * 1000 + n + 1, payload, length); while (*length == 0 && ++n);
+	return n;
+}
+
+static void server_handler(void *context, int port, cobs_status status, const uint8_t *frame, size_t length)
+{
+	server_check *check = context;
+	uint8_t expected[300];
+	size_t expected_length;
+	if (port < 0 || port >= SERVER_PORTS) check->failed = true;
+	else if (status == COBS_CLOSED) check->hangups++;
+	else if (status != COBS_OK) check->errors++;
+	else
+	{
+		check->next[port] = server_frame(port, check->next[port], expected, &expected_length) + 1;
+		if (length != expected_length || memcmp(frame, expected, length) != 0)
+		{
+			printf("%30s: Failed, port %d frame %lu\n", __func__, port, (unsigned long)check->next[port] - 1);
+			check->failed = true;
+		}
+	}
+}
+
+bool test_cobs_server_ptys(void)
+{
+	SETUP_TEST;
+	static uint8_t streams[SERVER_PORTS][SERVER_FRAMES * COBS_ENCODE_MAX_LENGTH(300)];
+	size_t stream_length[SERVER_PORTS], sent[SERVER_PORTS] = { 0 };
+	uint32_t last[SERVER_PORTS];                // next[] once every frame is in
+	int masters[SERVER_PORTS], slaves[SERVER_PORTS];
+	server_check check = { { 0 }, 0, 0, false };
+	cobs_server *server = cobs_server_create(300, server_handler, &check);
+	if (server == NULL) return false;
+
+	for (int p = 0; p < SERVER_PORTS; p++)
+	{
+		masters[p] = posix_openpt(O_RDWR | O_NOCTTY);
+		if (masters[p] < 0 || grantpt(masters[p]) || unlockpt(masters[p])) return false;
+		slaves[p] = open(ptsname(masters[p]), O_RDWR | O_NOCTTY);
+		struct termios raw;
+		if (slaves[p] < 0 || tcgetattr(slaves[p], &raw)) return false;
+		cfmakeraw(&raw);
+		tcsetattr(slaves[p], TCSANOW, &raw);
+		fcntl(masters[p], F_SETFL, fcntl(masters[p], F_GETFL) | O_NONBLOCK);
+		ASSERT_EQUAL_LUINT(cobs_server_add(server, slaves[p]), p);
+
+		uint8_t payload[300];
+		size_t length, pos = 0;
+		if (p == 0)
+		{
+			memcpy(streams[p], "\x05\x11\x22\x00", 4);   // block runs past the terminator
+			pos = 4;
+		}
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < SERVER_FRAMES; i++, n++)
+		{
+			n = server_frame(p, n, payload, &length);
+			pos += cobs_encode_frame(payload, length, streams[p] + pos, true);
+		}
+		stream_length[p] = pos;
+		last[p] = n;
+	}
+
+	for (int spins = 0; spins < 100000; spins++)
+	{
+		bool all_sent = true;
+		for (int p = 0; p < SERVER_PORTS; p++)
+		{
+			size_t chunk = 1 + test_rand_byte(0) % 97;
+			if (chunk > stream_length[p] - sent[p]) chunk = stream_length[p] - sent[p];
+			ssize_t n = chunk ? write(masters[p], streams[p] + sent[p], chunk) : 0;
+			if (n > 0) sent[p] += (size_t)n;
+			all_sent &= sent[p] == stream_length[p];
+		}
+		if (cobs_server_poll(server, all_sent ? 10 : 0) < 0) return false;
+		bool all_received = true;
+		for (int p = 0; p < SERVER_PORTS; p++) all_received &= check.next[p] == last[p];
+		if ((all_sent && all_received) || check.failed) break;
+	}
+	if (check.failed) return false;
+	ASSERT_EQUAL_LUINT(check.errors, 1);
+	for (int p = 0; p < SERVER_PORTS; p++) ASSERT_EQUAL_LUINT(check.next[p], last[p]);
+
+	for (int p = 0; p < SERVER_PORTS; p++) close(masters[p]);
+	for (int spins = 0; spins < 100 && check.hangups < SERVER_PORTS; spins++) cobs_server_poll(server, 10);
+	ASSERT_EQUAL_LUINT(check.hangups, SERVER_PORTS);
+	ASSERT_EQUAL_LUINT(cobs_server_poll(server, 0), 0);
+	cobs_server_destroy(server);
+	for (int p = 0; p < SERVER_PORTS; p++) close(slaves[p]);
+	return true;
+}
+#endif
+
+// The stats: a few frames encoded and decoded here and on a thread that has exited by the time they are
+// read, one bad frame for each reason, and the counts, histograms and overhead that should come of them.
+// Without COBS_ENABLE_STATS nothing is counted and reading says so.
+#ifdef COBS_ENABLE_STATS
+static const uint8_t stats_payload[] = { 0x11, 0x22, 0x00, 0x33 };
+
+static pthread_key_t stats_late_key;
+
+// a destructor that runs after the stats' own one has folded this thread's counts in and freed them
+static void stats_late_encode(void *arg)
+{
+	uint8_t encoded[8];
+	cobs_encode_frame(stats_payload, sizeof(stats_payload), encoded, true);
+	(void)arg;
+}
+
+static void *stats_thread(void *arg)
+{
+	uint8_t encoded[8];
+	cobs_encode_frame(stats_payload, sizeof(stats_payload), encoded, true);
+	if (arg) pthread_setspecific(stats_late_key, arg);
+	return arg;
+}
+#endif
+
+bool test_cobs_stats(void)
+{
+	SETUP_TEST;
+	cobs_stats stats;
+#ifndef COBS_ENABLE_STATS
+	ASSERT_EQUAL_LUINT(cobs_stats_read(&stats), false);
+	ASSERT_EQUAL_LUINT(stats.frames_encoded, 0);
+	return true;
+#else
+	cobs_stats_reset();
+	uint8_t encoded[8], decoded[8];
+	ASSERT_EQUAL_LUINT(cobs_encode_frame(stats_payload, sizeof(stats_payload), encoded, true), 6);
+	pthread_t thread;
+	pthread_create(&thread, NULL, stats_thread, NULL);
+	pthread_join(thread, NULL);
+	ASSERT_EQUAL_LUINT(cobs_decode(encoded, 5, decoded), 4);
+
+	const uint8_t zero_code[] = { 0x02, 0x11, 0x00 }, overrun[] = { 0x05, 0x11 }, embedded[] = { 0x03, 0x11, 0x00 };
+	ASSERT_EQUAL_LUINT(cobs_decode(zero_code, sizeof(zero_code), decoded), 0);
+	ASSERT_EQUAL_LUINT(cobs_decode(overrun, sizeof(overrun), decoded), 0);
+	ASSERT_EQUAL_LUINT(cobs_decode(embedded, sizeof(embedded), decoded), 0);
+	cobs_receiver rx;
+	size_t consumed;
+	cobs_receiver_init(&rx, decoded, 2);
+	ASSERT_EQUAL_LUINT(cobs_receiver_feed(&rx, encoded, 6, &consumed), COBS_ERR_OVERFLOW);
+	ASSERT_EQUAL_LUINT(consumed, 3);
+
+	ASSERT_EQUAL_LUINT(cobs_stats_read(&stats), true);
+	ASSERT_EQUAL_LUINT(stats.frames_encoded, 2);
+	ASSERT_EQUAL_LUINT(stats.encode_bytes_in, 8);
+	ASSERT_EQUAL_LUINT(stats.encode_bytes_out, 12);
+	ASSERT_EQUAL_LUINT(stats.frames_decoded, 1);
+	ASSERT_EQUAL_LUINT(stats.decode_bytes_in, 5 + 3);
+	ASSERT_EQUAL_LUINT(stats.decode_bytes_out, 4);
+	ASSERT_EQUAL_LUINT(stats.decode_failures[COBS_FAIL_ZERO_CODE], 1);
+	ASSERT_EQUAL_LUINT(stats.decode_failures[COBS_FAIL_OVERRUN], 1);
+	ASSERT_EQUAL_LUINT(stats.decode_failures[COBS_FAIL_EMBEDDED_ZERO], 1);
+	ASSERT_EQUAL_LUINT(stats.decode_failures[COBS_FAIL_OVERFLOW], 1);
+	ASSERT_EQUAL_LUINT(stats.decode_failures[COBS_FAIL_CRC], 0);
+	ASSERT_EQUAL_LUINT(stats.frame_sizes[3], 3);                 // 4 bytes: two encoded, one decoded
+#if COBS_STATS_BLOCK_SAMPLE == 1
+	ASSERT_EQUAL_LUINT(stats.block_lengths[1], 3);               // 1 data byte: 2 encoded, 1 decoded
+	ASSERT_EQUAL_LUINT(stats.block_lengths[2], 4);               // 2 data bytes: 2 encoded, 1 decoded, 1 received
+#else
+	ASSERT_EQUAL_LUINT(stats.block_lengths[1] <= 3 && stats.block_lengths[2] <= 4, true);
+#endif
+	ASSERT_EQUAL_LUINT(cobs_stats_overhead(&stats) == 0.5, true);
+
+	size_t length = cobs_encode_crc(stats_payload, sizeof(stats_payload), encoded, COBS_CRC16_CCITT, true, false, NULL);
+	encoded[1] ^= 0x40;
+	ASSERT_EQUAL_LUINT(cobs_decode_crc(encoded, length, decoded, COBS_CRC16_CCITT, true, &length, NULL), COBS_ERR_CRC);
+	cobs_stats_read(&stats);
+	ASSERT_EQUAL_LUINT(stats.decode_failures[COBS_FAIL_CRC], 1);
+
+	// a thread that encodes once more while it is being torn down: both frames are counted
+	cobs_stats_reset();
+	pthread_key_create(&stats_late_key, stats_late_encode);
+	pthread_create(&thread, NULL, stats_thread, &stats_late_key);
+	pthread_join(thread, NULL);
+	pthread_key_delete(stats_late_key);
+	cobs_stats_read(&stats);
+	ASSERT_EQUAL_LUINT(stats.frames_encoded, 2);
+
+	// a parallel encode is one frame, however many pieces it was cut into
+	cobs_stats_reset();
+	const size_t parallel_length = 2 * COBS_PARALLEL_THRESHOLD;
+	uint8_t *parallel_input = calloc(parallel_length, 1);
+	uint8_t *parallel_output = malloc(COBS_ENCODE_MAX_LENGTH(parallel_length));
+	cobs_pool *pool = cobs_pool_create(2);
+	length = cobs_encode_parallel(pool, parallel_input, parallel_length, parallel_output);
+	cobs_pool_destroy(pool);
+	free(parallel_input);
+	free(parallel_output);
+	cobs_stats_read(&stats);
+	ASSERT_EQUAL_LUINT(stats.frames_encoded, 1);
+	ASSERT_EQUAL_LUINT(stats.encode_bytes_in, parallel_length);
+	ASSERT_EQUAL_LUINT(stats.encode_bytes_out, length);
+
+	cobs_stats_reset();
+	cobs_stats_read(&stats);
+	ASSERT_EQUAL_LUINT(stats.frames_encoded, 0);
+	ASSERT_EQUAL_LUINT(stats.block_lengths[1], 0);
+	ASSERT_EQUAL_LUINT(stats.block_lengths[2], 0);
+	return true;
+#endif
+}
+
+// The three validation policies fuzzed against cobs_decode: valid frames of every zero density, where all
+// three must agree byte for byte, then the same frames mangled, where STRICT and DEFERRED must still agree
+// and TRUSTED, whatever it makes of them, must stay inside its input and its length bytes of output.
+bool test_cobs_decode_validated(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 1, 2, 7, 64, 253, 254, 255, 1000 };
+	static uint8_t payload[LONG_TEST_SIZE];
+	static uint8_t encoded[COBS_ENCODE_MAX_LENGTH(LONG_TEST_SIZE) + 1];
+	static uint8_t expected[LONG_TEST_SIZE + 1], decoded[LONG_TEST_SIZE + 64];
+	static const cobs_validation policies[] = { COBS_VALIDATE_STRICT, COBS_VALIDATE_TRUSTED, COBS_VALIDATE_DEFERRED };
+
+	for (int round = 0; round < 400; round++)
+	{
+		size_t length = round < 300 ? (size_t)round : (size_t)test_rand_byte(0) * 17 % LONG_TEST_SIZE;
+		unsigned every = densities[round % (sizeof(densities) / sizeof(densities[0]))];
+		for (size_t i = 0; i < length; i++) payload[i] = test_rand_byte(every);
+		size_t encoded_length = cobs_encode_frame(payload, length, encoded, false);
+		size_t expected_length = cobs_decode(encoded, encoded_length, expected);
+		ASSERT_EQUAL_LUINT(expected_length, length);
+		for (size_t p = 0; p < 3; p++)
+		{
+			memset(decoded, MARKER_BYTE, sizeof(decoded));
+			ASSERT_EQUAL_LUINT(cobs_decode_validated(encoded, encoded_length, decoded, policies[p]), length);
+			ASSERT_EQUAL_MEM("POLICY", decoded, payload, length);
+			ASSERT_EQUAL_LUINT(decoded[length], MARKER_BYTE);
+		}
+
+		if (encoded_length == 0) continue;
+		for (int mangle = 0; mangle < 4; mangle++)
+		{
+			size_t at = (size_t)(test_rand_byte(0) | test_rand_byte(0) << 8) % encoded_length;
+			encoded[at] = mangle == 0 ? 0 : test_rand_byte(0) ^ (uint8_t)mangle;
+			expected_length = cobs_decode(encoded, encoded_length, expected);
+			memset(decoded, MARKER_BYTE, sizeof(decoded));
+			ASSERT_EQUAL_LUINT(cobs_decode_validated(encoded, encoded_length, decoded, COBS_VALIDATE_DEFERRED), expected_length);
+			ASSERT_EQUAL_MEM("DEFERRED", decoded, expected, expected_length);
+			ASSERT_EQUAL_LUINT(cobs_decode_validated(encoded, encoded_length, decoded, COBS_VALIDATE_STRICT), expected_length);
+			memset(decoded, MARKER_BYTE, sizeof(decoded));
+			size_t trusted = cobs_decode_validated(encoded, encoded_length, decoded, COBS_VALIDATE_TRUSTED);
+			ASSERT_EQUAL_LUINT(trusted <= encoded_length, true);
+			for (size_t i = encoded_length; i < sizeof(decoded); i++) ASSERT_EQUAL_LUINT(decoded[i], MARKER_BYTE);
+			if (expected_length) ASSERT_EQUAL_MEM("TRUSTED", decoded, expected, expected_length);
+		}
+	}
+	return true;
+}
+
+// Batch encode of a few hundred messages of 0 to 300 bytes at every zero density, sitting apart in memory as
+// they would on a heap: each frame at its offset must be what cobs_encode_frame gives, terminator included,
+// with nothing written past the end, and the same again with no offsets asked for.
+bool test_cobs_encode_batch(void)
+{
+	SETUP_TEST;
+	enum { MESSAGES = 300, MESSAGE_MAX = 300 };
+	static const unsigned densities[] = { 0, 1, 4, 60, 255, 700 };
+	static uint8_t payloads[MESSAGES][MESSAGE_MAX];
+	static uint8_t encoded[MESSAGES * COBS_ENCODE_MAX_LENGTH(MESSAGE_MAX) + 64];
+	static uint8_t expected[COBS_ENCODE_MAX_LENGTH(MESSAGE_MAX)];
+	struct iovec messages[MESSAGES];
+	size_t offsets[MESSAGES];
+
+	size_t total = 0;
+	for (size_t m = 0; m < MESSAGES; m++)
+	{
+		size_t length = m < 20 ? m : (size_t)test_rand_byte(0) * MESSAGE_MAX / 256;
+		for (size_t i = 0; i < length; i++) payloads[m][i] = test_rand_byte(densities[m % 6]);
+		messages[m].iov_base = payloads[m];
+		messages[m].iov_len = length;
+		total += cobs_encode_frame(payloads[m], length, expected, true);
+	}
+
+	memset(encoded, MARKER_BYTE, sizeof(encoded));
+	ASSERT_EQUAL_LUINT(cobs_encode_batch(messages, 0, encoded, offsets), 0);
+	ASSERT_EQUAL_LUINT(cobs_encode_batch(messages, MESSAGES, encoded, offsets), total);
+	ASSERT_EQUAL_LUINT(encoded[total], MARKER_BYTE);
+	for (size_t m = 0; m < MESSAGES; m++)
+	{
+		size_t expected_length = cobs_encode_frame(payloads[m], messages[m].iov_len, expected, true);
+		size_t next = m + 1 < MESSAGES ? offsets[m + 1] : total;
+		ASSERT_EQUAL_LUINT(next - offsets[m], expected_length);
+		ASSERT_EQUAL_MEM("BATCH", encoded + offsets[m], expected, expected_length);
+	}
+
+	static uint8_t again[sizeof(encoded)];
+	ASSERT_EQUAL_LUINT(cobs_encode_batch(messages, MESSAGES, again, NULL), total);
+	ASSERT_EQUAL_MEM("NO OFFSETS", again, encoded, total);
+	return true;
+}
+
+// Views of frames of every length and zero density, long enough to fill the index many times over: the
+// segments must add up to the payload, and every byte and every field read from any offset must match it.
+// A mangled frame must be refused exactly when cobs_decode refuses it.
+bool test_cobs_view(void)
+{
+	SETUP_TEST;
+	static const unsigned densities[] = { 0, 1, 2, 7, 64, 254, 255, 1000 };
+	static uint8_t payload[LONG_TEST_SIZE], joined[LONG_TEST_SIZE + 1];
+	static uint8_t encoded[COBS_ENCODE_MAX_LENGTH(LONG_TEST_SIZE)];
+	static uint8_t field[LONG_TEST_SIZE + 1];
+	cobs_view view;
+	cobs_segment segment;
+
+	for (int round = 0; round < 300; round++)
+	{
+		size_t length = round < 200 ? (size_t)round : LONG_TEST_SIZE - (size_t)test_rand_byte(0);
+		for (size_t i = 0; i < length; i++) payload[i] = test_rand_byte(densities[round % 8]);
+		size_t encoded_length = cobs_encode_frame(payload, length, encoded, false);
+		ASSERT_EQUAL_LUINT(cobs_view_init(&view, encoded, encoded_length), true);
+		ASSERT_EQUAL_LUINT(view.decoded_length, length);
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			size_t joined_length = 0;
+			while (cobs_view_next(&view, &segment))
+			{
+				memcpy(joined + joined_length, segment.data, segment.length);
+				joined_length += segment.length;
+				if (segment.followed_by_zero) joined[joined_length++] = 0;
+			}
+			ASSERT_EQUAL_LUINT(joined_length, length);
+			ASSERT_EQUAL_MEM("SEGMENTS", joined, payload, length);
+			cobs_view_rewind(&view);
+		}
+
+		for (size_t i = 0; i < length; i++) ASSERT_EQUAL_LUINT(cobs_view_byte(&view, i), payload[i]);
+		ASSERT_EQUAL_LUINT(cobs_view_byte(&view, length), -1);
+		for (int reads = 0; reads < 20 && length > 0; reads++)
+		{
+			size_t offset = (size_t)(test_rand_byte(0) | test_rand_byte(0) << 8) % length;
+			size_t n = (size_t)test_rand_byte(0) * (reads % 5 + 1);
+			size_t expected = n < length - offset ? n : length - offset;
+			memset(field, MARKER_BYTE, sizeof(field));
+			ASSERT_EQUAL_LUINT(cobs_view_read(&view, offset, field, n), expected);
+			ASSERT_EQUAL_MEM("FIELD", field, payload + offset, expected);
+			ASSERT_EQUAL_LUINT(field[expected], MARKER_BYTE);
+		}
+		ASSERT_EQUAL_LUINT(cobs_view_read(&view, length, field, 1), 0);
+
+		if (encoded_length == 0) continue;
+		size_t at = (size_t)(test_rand_byte(0) | test_rand_byte(0) << 8) % encoded_length;
+		encoded[at] = round % 2 ? 0 : test_rand_byte(0);
+		size_t decoded_length = cobs_decode(encoded, encoded_length, joined);
+		bool valid = cobs_view_init(&view, encoded, encoded_length);
+		if (decoded_length) ASSERT_EQUAL_LUINT(valid, true);
+		if (!valid)
+		{
+			ASSERT_EQUAL_LUINT(decoded_length, 0);
+			ASSERT_EQUAL_LUINT(cobs_view_next(&view, &segment), false);
+			ASSERT_EQUAL_LUINT(cobs_view_byte(&view, 0), -1);
+			continue;
+		}
+		ASSERT_EQUAL_LUINT(view.decoded_length, decoded_length);
+		ASSERT_EQUAL_LUINT(cobs_view_read(&view, 0, field, sizeof(field)), decoded_length);
+		ASSERT_EQUAL_MEM("MANGLED", field, joined, decoded_length);
+	}
+	return true;
+}
+
+#endif // COBS_TEST_CORE_ONLY
+
 // We're done testing the correctness of encode/decode. WHat remains now is to check that the decoder 
 // returns zero when passed an invalid COBS packet - i.e. when the header (and/or the bytes it links
 // to) extend beyond the length of the input.
@@ -327,6 +1886,43 @@ bool test_utils_cobs_fail_on_null(void)
 	return true;
 }
 
+#ifndef COBS_TEST_CORE_ONLY
+bool test_utils_cobs_decode_inplace_invalid(void)
+{
+	SETUP_TEST;
+	// the frames above that cobs_decode rejects must be rejected in place as well: header overrun ...
+	uint8_t overrun[] = { 0x2d, 0x51, 0x32, 0x30, 0x0f, 0x31, 0x30, 0x31, 0x38, 0x20 };
+	ASSERT_EQUAL_LUINT(0, cobs_decode_inplace(overrun, sizeof(overrun)));
+	uint8_t chained_overrun[] = { 0x03, 0x51, 0x32, 0x05, 0x31, 0x30, 0x31 };
+	ASSERT_EQUAL_LUINT(0, cobs_decode_inplace(chained_overrun, sizeof(chained_overrun)));
+	// ... and a NULL anywhere in the frame
+	uint8_t good_input[] = { 0x03, 0x11, 0x22, 0x03, 0x33, 0x44};
+	uint8_t bad_input[sizeof(good_input)];
+	for (uint8_t i = 0; i < sizeof(good_input); i++)
+	{
+		memcpy(bad_input, good_input, sizeof(good_input));
+		bad_input[i] = 0;
+		ASSERT_EQUAL_LUINT(0, cobs_decode_inplace(bad_input, sizeof(bad_input)));
+	}
+	// long frames agree with cobs_decode, and never touch the byte after the encoded frame
+	static uint8_t test_data[LONG_TEST_SIZE];
+	static uint8_t encoded[LONG_TEST_SIZE + LONG_TEST_SIZE / 254 + 3];
+	static uint8_t decoded[sizeof(encoded)];
+	for (size_t length = 1; length <= LONG_TEST_SIZE; length += 7)
+	{
+		for (size_t i = 0; i < length; i++) test_data[i] = test_rand_byte(length % 9);
+		size_t encoded_length = reference_encode(test_data, length, encoded);
+		if (length % 3 == 0) encoded[test_rand_state % encoded_length] ^= (uint8_t)(test_rand_state >> 11);
+		size_t expected_length = cobs_decode(encoded, encoded_length, decoded);
+		encoded[encoded_length] = MARKER_BYTE;
+		ASSERT_EQUAL_LUINT(cobs_decode_inplace(encoded, encoded_length), expected_length);
+		ASSERT_EQUAL_MEM("INPLACE", encoded, decoded, expected_length);
+		ASSERT_EQUAL_LUINT(encoded[encoded_length], MARKER_BYTE);
+	}
+	return true;
+}
+#endif
+
 int main(int argc, char*argv[])
 {
     test_single_null();
@@ -341,10 +1937,41 @@ int main(int argc, char*argv[])
 	test_cobs_encode_255_bytes_no_null();
 	test_cobs_encode_254_bytes_trailing_null();
 	test_cobs_encode_254_bytes_trailing_null_one();
+	test_cobs_encode_long_random();
+	test_cobs_decode_long_random();
+#ifndef COBS_TEST_CORE_ONLY
+	test_cobs_encoder_chunks();
+	test_cobs_encoded_length();
+	test_cobs_encode_inplace_long();
+	test_cobs_delim_all_values();
+	test_cobs_reduced();
+	test_cobs_zpe();
+	test_cobs_crc();
+	test_cobs_encodev_segments();
+	test_cobs_encode_ring();
+	test_cobs_encode_parallel();
+	test_cobs_receiver_chunks();
+	test_cobs_decode_batch();
+	test_cobs_pipeline_order();
+	test_cobs_frame_pool();
+	test_cobs_frame_pool_threads();
+	test_cobs_queue();
+	test_cobs_queue_threads();
+#ifdef COBS_TEST_SERVER
+	test_cobs_server_ptys();
+#endif
+	test_cobs_stats();
+	test_cobs_decode_validated();
+	test_cobs_encode_batch();
+	test_cobs_view();
+#endif
 	
 	test_utils_cobs_decode_header_too_large_1();
 	test_utils_cobs_decode_header_too_large_2();
 	test_utils_cobs_fail_on_null();
+#ifndef COBS_TEST_CORE_ONLY
+	test_utils_cobs_decode_inplace_invalid();
+#endif
 	
 	
 	printf("ran %d COBS unit tests\n", test_count);
@@ -0,0 +1,226 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ */
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <array>
+#include "cobs.hpp"
+
+// The vectors of cobs_test.c, for cobs.hpp. Each one is checked twice: by static_assert, with the compiler
+// doing the encoding and decoding, and again at run time with the same marker byte checks as cobs_test.c.
+// Both are done for terminator 0 and for non-zero terminators, where the expected frame is XORed with it.
+
+#define MARKER_BYTE 0xAB
+#define MAX_TEST_SIZE 260
+
+#define ASSERT_EQUAL_LUINT(value, expected) \
+    do {\
+        if( (value) != (expected) ) { \
+            printf( "%30s: Failed, %s != %s. Expected %lu, got %lu (terminator 0x%02X)\n", test, #value, #expected, (unsigned long)(expected), (unsigned long)(value), Terminator ); \
+            return false; \
+        } \
+    } while(0)
+
+#define ASSERT_EQUAL_MEM(path, value, expected, length) \
+    do {\
+        for( size_t n = 0; n < (length); n++ ) { \
+            if( (value)[n] != (expected)[n] ) { \
+                printf( "%30s: Failed, %s != %s. Expected %s[%lu] = 0x%02X, got 0x%02X (%s, terminator 0x%02X)\n", test, #value, #expected, #value, (unsigned long)n, (expected)[n], (value)[n], path, Terminator ); \
+                return false; \
+            } \
+        } \
+   } while(0)
+
+static unsigned int test_count = 0;
+static uint8_t working_buffer[MAX_TEST_SIZE];
+
+template <size_t N, class F>
+constexpr std::array<uint8_t, N> make(F f)
+{
+	std::array<uint8_t, N> a{};
+	for (size_t i = 0; i < N; i++) a[i] = (uint8_t)f(i);
+	return a;
+}
+
+template <uint8_t Terminator, size_t N>
+constexpr std::array<uint8_t, N> xored(const std::array<uint8_t, N> & a)
+{
+	std::array<uint8_t, N> x{};
+	for (size_t i = 0; i < N; i++) x[i] = a[i] ^ Terminator;
+	return x;
+}
+
+template <size_t C, size_t N>
+constexpr bool same(const cobs::buffer<C> & frame, const std::array<uint8_t, N> & expected)
+{
+	if (frame.size() != N) return false;
+	for (size_t i = 0; i < N; i++) if (frame[i] != expected[i]) return false;
+	return true;
+}
+
+template <uint8_t Terminator, size_t N, size_t M>
+constexpr bool vector_ok(const std::array<uint8_t, N> & test_data, const std::array<uint8_t, M> & expected)
+{
+	return same(cobs::encode<Terminator>(test_data), xored<Terminator>(expected)) &&
+		same(cobs::decode<Terminator>(xored<Terminator>(expected)), test_data) &&
+		cobs::encoded_length(test_data) == M;
+}
+
+template <size_t N, size_t M>
+constexpr bool vector_ok_all(const std::array<uint8_t, N> & test_data, const std::array<uint8_t, M> & expected)
+{
+	return vector_ok<0x00>(test_data, expected) && vector_ok<0x7E>(test_data, expected) && vector_ok<0xFF>(test_data, expected);
+}
+
+// Wikipedia Example 1
+constexpr std::array<uint8_t, 1> single_null_data{ 0 };
+constexpr std::array<uint8_t, 2> single_null_expected{ 1, 1 };
+// Wikipedia Example 2
+constexpr std::array<uint8_t, 2> double_null_data{ 0, 0 };
+constexpr std::array<uint8_t, 3> double_null_expected{ 1, 1, 1 };
+// not in wikipedia
+constexpr std::array<uint8_t, 1> hex1_data{ 1 };
+constexpr std::array<uint8_t, 2> hex1_expected{ 2, 1 };
+// Wikipedia Example 3
+constexpr std::array<uint8_t, 3> three_bytes_data{ 0x00, 0x11, 0x00 };
+constexpr std::array<uint8_t, 4> three_bytes_expected{ 0x01, 0x02, 0x11, 0x01 };
+// Wikipedia Example 4
+constexpr std::array<uint8_t, 4> short_with_null_data{ 0x11, 0x22, 0x00, 0x33 };
+constexpr std::array<uint8_t, 5> short_with_null_expected{ 0x03, 0x11, 0x22, 0x02, 0x33 };
+// Wikipedia Example 5
+constexpr std::array<uint8_t, 4> short_no_null_data{ 0x11, 0x22, 0x33, 0x44 };
+constexpr std::array<uint8_t, 5> short_no_null_expected{ 0x05, 0x11, 0x22, 0x33, 0x44 };
+// Wikipedia Example 6
+constexpr std::array<uint8_t, 4> successive_nulls_data{ 0x11, 0x00, 0x00, 0x00 };
+constexpr std::array<uint8_t, 5> successive_nulls_expected{ 0x02, 0x11, 0x01, 0x01, 0x01 };
+// Wikipedia Example 7
+constexpr auto no_null_254_data = make<254>([](size_t i) { return i + 1; });
+constexpr auto no_null_254_expected = make<255>([](size_t i) { return i ? i : 0xFF; });
+// Wikipedia Example 8
+constexpr auto leading_null_255_data = make<255>([](size_t i) { return i; });
+constexpr auto leading_null_255_expected = make<256>([](size_t i) { return i == 0 ? 0x01 : i == 1 ? 0xFF : i - 1; });
+// Wikipedia Example 9
+constexpr auto no_null_255_data = make<255>([](size_t i) { return i + 1; });
+constexpr auto no_null_255_expected = make<257>([](size_t i) { return i == 0 ? 0xFF : i <= 254 ? i : i == 255 ? 0x02 : 0xFF; });
+// Wikipedia Example 10
+constexpr auto trailing_null_254_data = make<255>([](size_t i) { return i <= 253 ? i + 2 : 0x00; });
+constexpr auto trailing_null_254_expected = make<257>([](size_t i) { return i == 0 ? 0xFF : i <= 254 ? i + 1 : 0x01; });
+// Wikipedia Example 11
+constexpr auto trailing_null_one_254_data = make<255>([](size_t i) { return i <= 252 ? i + 3 : i == 253 ? 0x00 : 0x01; });
+constexpr auto trailing_null_one_254_expected = make<256>([](size_t i) { return i == 0 ? 0xFE : i <= 253 ? i + 2 : i == 254 ? 0x02 : 0x01; });
+
+static_assert(vector_ok_all(single_null_data, single_null_expected), "Wikipedia Example 1");
+static_assert(vector_ok_all(double_null_data, double_null_expected), "Wikipedia Example 2");
+static_assert(vector_ok_all(hex1_data, hex1_expected), "hex1");
+static_assert(vector_ok_all(three_bytes_data, three_bytes_expected), "Wikipedia Example 3");
+static_assert(vector_ok_all(short_with_null_data, short_with_null_expected), "Wikipedia Example 4");
+static_assert(vector_ok_all(short_no_null_data, short_no_null_expected), "Wikipedia Example 5");
+static_assert(vector_ok_all(successive_nulls_data, successive_nulls_expected), "Wikipedia Example 6");
+static_assert(vector_ok_all(no_null_254_data, no_null_254_expected), "Wikipedia Example 7");
+static_assert(vector_ok_all(leading_null_255_data, leading_null_255_expected), "Wikipedia Example 8");
+static_assert(vector_ok_all(no_null_255_data, no_null_255_expected), "Wikipedia Example 9");
+static_assert(vector_ok_all(trailing_null_254_data, trailing_null_254_expected), "Wikipedia Example 10");
+static_assert(vector_ok_all(trailing_null_one_254_data, trailing_null_one_254_expected), "Wikipedia Example 11");
+
+// a fixed command frame costs nothing at run time
+constexpr auto command_frame = cobs::encode<0x7E>(std::array<uint8_t, 3>{ 0x01, 0x00, 0x02 });
+static_assert(command_frame.size() == 4 && command_frame[0] == (0x02 ^ 0x7E) && command_frame[2] == (0x02 ^ 0x7E), "command frame");
+
+// invalid frames decode to nothing, as with cobs_decode
+static_assert(cobs::decode(std::array<uint8_t, 3>{ 0x05, 0x11, 0x22 }).size() == 0, "header too large");
+static_assert(cobs::decode(std::array<uint8_t, 4>{ 0x04, 0x11, 0x00, 0x22 }).size() == 0, "NULL in frame");
+static_assert(cobs::decode<0x7E>(std::array<uint8_t, 4>{ 0x04 ^ 0x7E, 0x11, 0x7E, 0x22 }).size() == 0, "terminator in frame");
+
+template <uint8_t Terminator, size_t N, size_t M>
+bool run_vector(const char * test, const std::array<uint8_t, N> & test_data, const std::array<uint8_t, M> & raw_expected)
+{
+	const std::array<uint8_t, M> expected = xored<Terminator>(raw_expected);
+
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));
+	size_t encoded_length = cobs::encode<Terminator>(test_data.data(), N, working_buffer);
+	ASSERT_EQUAL_LUINT(encoded_length, M);
+	ASSERT_EQUAL_MEM("FWD", working_buffer, expected, M);
+	for (size_t i = M; i < MAX_TEST_SIZE; i++) ASSERT_EQUAL_LUINT(working_buffer[i], MARKER_BYTE);
+
+	memset(working_buffer, MARKER_BYTE, sizeof(working_buffer));
+	size_t decoded_length = cobs::decode<Terminator>(expected.data(), M, working_buffer);
+	ASSERT_EQUAL_LUINT(decoded_length, N);
+	ASSERT_EQUAL_MEM("REV", working_buffer, test_data, N);
+	for (size_t i = N; i < MAX_TEST_SIZE; i++) ASSERT_EQUAL_LUINT(working_buffer[i], MARKER_BYTE);
+	return true;
+}
+
+#define VECTOR_TEST(name) \
+	bool test_##name(void) \
+	{ \
+		test_count++; \
+		const char * test = #name; \
+		return run_vector<0x00>(test, name##_data, name##_expected) && run_vector<0x7E>(test, name##_data, name##_expected) && \
+			run_vector<0xFF>(test, name##_data, name##_expected); \
+	}
+
+VECTOR_TEST(single_null)
+VECTOR_TEST(double_null)
+VECTOR_TEST(hex1)
+VECTOR_TEST(three_bytes)
+VECTOR_TEST(short_with_null)
+VECTOR_TEST(short_no_null)
+VECTOR_TEST(successive_nulls)
+VECTOR_TEST(no_null_254)
+VECTOR_TEST(leading_null_255)
+VECTOR_TEST(no_null_255)
+VECTOR_TEST(trailing_null_254)
+VECTOR_TEST(trailing_null_one_254)
+
+#if __cplusplus >= 202002L
+// Long frames through the span interface round trip, and encoded_length agrees with encode.
+bool test_span_long(void)
+{
+	test_count++;
+	const char * test = __func__;
+	constexpr uint8_t Terminator = 0x7E;
+	static uint8_t test_data[1200], encoded[cobs::max_encoded_size(1200)], decoded[sizeof(encoded)];
+	uint32_t state = 12345;
+	for (size_t length = 0; length <= sizeof(test_data); length += 7)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			state = state * 1103515245u + 12345u;
+			test_data[i] = (state >> 16) % 3 ? (uint8_t)(state >> 8) : Terminator;
+		}
+		std::span<const uint8_t> input(test_data, length);
+		size_t encoded_length = cobs::encode<Terminator>(input, encoded);
+		ASSERT_EQUAL_LUINT(encoded_length, cobs::encoded_length(input));
+		for (size_t i = 0; i < encoded_length; i++) ASSERT_EQUAL_LUINT(encoded[i] != Terminator, true);
+		size_t decoded_length = cobs::decode<Terminator>(std::span<const uint8_t>(encoded, encoded_length), decoded);
+		if (length) ASSERT_EQUAL_LUINT(decoded_length, length);
+		ASSERT_EQUAL_MEM("REV", decoded, test_data, length);
+	}
+	return true;
+}
+#endif
+
+int main(int argc, char*argv[])
+{
+	test_single_null();
+	test_double_null();
+	test_hex1();
+	test_three_bytes();
+	test_short_with_null();
+	test_short_no_null();
+	test_successive_nulls();
+	test_no_null_254();
+	test_leading_null_255();
+	test_no_null_255();
+	test_trailing_null_254();
+	test_trailing_null_one_254();
+#if __cplusplus >= 202002L
+	test_span_long();
+#endif
+
+	printf("ran %d COBS unit tests\n", test_count);
+
+	return 0;
+}
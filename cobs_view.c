@@ -0,0 +1,131 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#include "cobs_view.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+// The check is the one cobs_decode_validated makes for DEFERRED: memchr for a NULL anywhere, then a walk along
+// the code bytes, which here also adds up the decoded length and fills in the index. Block k is indexed when k
+// is a multiple of the stride; when the index fills up, every second entry is dropped and the stride doubles.
+bool cobs_view_init(cobs_view * view, const uint8_t * frame, size_t length)
+{
+    view->frame = frame;
+    view->length = 0;
+    view->decoded_length = 0;
+    view->position = 0;
+    view->stride = 1;
+    view->entries = 0;
+    if (memchr(frame, 0, length) != NULL) return false;
+
+    size_t pos = 0, decoded = 0, blocks = 0;
+    while (pos < length)
+    {
+        size_t n = (size_t)frame[pos] - 1;
+        if (n > length - pos - 1) return false;             // overrun
+        if (blocks % view->stride == 0)
+        {
+            if (view->entries == COBS_VIEW_INDEX)
+            {
+                for (size_t i = 0; i < COBS_VIEW_INDEX / 2; i++) view->index[i] = view->index[2 * i];
+                view->entries = COBS_VIEW_INDEX / 2;
+                view->stride *= 2;
+            }
+            if (blocks % view->stride == 0)
+            {
+                view->index[view->entries].decoded = decoded;
+                view->index[view->entries].encoded = pos;
+                view->entries++;
+            }
+        }
+        blocks++;
+        bool zero = frame[pos] != 0xFF;
+        pos += 1 + n;
+        decoded += n + (zero && pos < length);
+    }
+    view->length = length;
+    view->decoded_length = decoded;
+    return true;
+}
+
+bool cobs_view_next(cobs_view * view, cobs_segment * segment)
+{
+    if (view->position >= view->length) return false;
+    const uint8_t * code = view->frame + view->position;
+    segment->data = code + 1;
+    segment->length = (size_t)*code - 1;
+    view->position += 1 + segment->length;
+    segment->followed_by_zero = *code != 0xFF && view->position < view->length;
+    return true;
+}
+
+void cobs_view_rewind(cobs_view * view)
+{
+    view->position = 0;
+}
+
+// the block holding payload byte offset (which may be the NULL after its data): the last index entry at or
+// before it, found by bisection, and from there a walk of at most stride blocks. *decoded is set to where the
+// block's data starts in the payload; the return value is where its code byte is in the frame.
+static size_t locate(const cobs_view * view, size_t offset, size_t * decoded)
+{
+    size_t lo = 0, hi = view->entries;
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (view->index[mid].decoded <= offset) lo = mid;
+        else hi = mid;
+    }
+    size_t pos = view->index[lo].encoded;
+    size_t start = view->index[lo].decoded;
+    for (;;)
+    {
+        uint8_t code = view->frame[pos];
+        size_t end = start + code - 1 + (code != 0xFF);    // past the data and its NULL
+        if (offset < end) break;
+        start = end;
+        pos += code;
+    }
+    *decoded = start;
+    return pos;
+}
+
+int cobs_view_byte(const cobs_view * view, size_t offset)
+{
+    if (offset >= view->decoded_length) return -1;
+    size_t start;
+    size_t pos = locate(view, offset, &start);
+    size_t n = (size_t)view->frame[pos] - 1;
+    return offset - start < n ? view->frame[pos + 1 + offset - start] : 0;
+}
+
+size_t cobs_view_read(const cobs_view * view, size_t offset, uint8_t * output, size_t n)
+{
+    if (offset >= view->decoded_length) return 0;
+    if (n > view->decoded_length - offset) n = view->decoded_length - offset;
+    size_t start;
+    size_t pos = locate(view, offset, &start);
+    size_t done = 0;
+    while (done < n)
+    {
+        uint8_t code = view->frame[pos];
+        size_t skip = offset + done - start;                // into this block, which may be past its data
+        size_t data = (size_t)code - 1;
+        if (skip < data)
+        {
+            size_t take = data - skip;
+            if (take > n - done) take = n - done;
+            memcpy(output + done, view->frame + pos + 1 + skip, take);
+            done += take;
+        }
+        if (done < n && code != 0xFF) output[done++] = 0;   // the NULL after the data
+        start += data + (code != 0xFF);
+        pos += code;
+    }
+    return n;
+}
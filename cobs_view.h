@@ -0,0 +1,66 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_VIEW_H
+#define COBS_VIEW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// VIEW of an encoded frame, for reading the payload without decoding it into a buffer. The decoded payload is
+// nothing but the data of each block, with a NULL after every block but the last one and the 254 byte ones, so
+// it can be walked as spans of the encoded frame itself, or read a field at a time. The frame is checked once,
+// as cobs_decode would check it, when the view is set up, and must stay put (and unchanged) while the view is in
+// use. The view holds a small index of where the blocks start, so that reading from the middle of a long frame
+// walks only a few blocks.
+
+// one block's data in the frame, and whether the payload has a NULL after it
+typedef struct
+{
+    const uint8_t * data;
+    size_t length;
+    bool followed_by_zero;
+} cobs_segment;
+
+// index entries kept by a view. A frame with more blocks than this has every second, fourth ... block indexed,
+// so that a read walks at most 2 * blocks / COBS_VIEW_INDEX blocks to find its first byte.
+#define COBS_VIEW_INDEX 32
+
+typedef struct
+{
+    const uint8_t * frame;
+    size_t length;                  // of the encoded frame (0 if it was not valid)
+    size_t decoded_length;          // of the payload
+    size_t position;                // in the frame, of the code byte of the next segment
+    size_t stride;                  // blocks between index entries
+    size_t entries;
+    struct
+    {
+        size_t decoded;             // offset in the payload of the block's data
+        size_t encoded;             // offset in the frame of its code byte
+    } index[COBS_VIEW_INDEX];
+} cobs_view;
+
+// SET UP a view of length bytes of a frame (its terminator already stripped). Returns false, and leaves a view
+// of an empty payload, if the frame is not valid, for the same reasons as cobs_decode: a NULL in it, or a code
+// byte pointing past its end.
+bool cobs_view_init(cobs_view * view, const uint8_t * frame, size_t length);
+
+// NEXT segment of the payload, in order, into *segment. Returns false once there are no more.
+bool cobs_view_next(cobs_view * view, cobs_segment * segment);
+
+// go back to the first segment
+void cobs_view_rewind(cobs_view * view);
+
+// the BYTE at offset in the payload, or -1 if the payload is not that long
+int cobs_view_byte(const cobs_view * view, size_t offset);
+
+// READ up to n bytes of the payload from offset on into output, and return the number read (fewer than n only
+// at the end of the payload).
+size_t cobs_view_read(const cobs_view * view, size_t offset, uint8_t * output, size_t n);
+
+#endif
@@ -0,0 +1,92 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#include "cobs_zpe.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define ZPE_MAX_RUN 222                     // data bytes in a 0xDF block
+#define ZPE_PAIR 0xE0                       // first code of the run + two NULLs blocks
+#define ZPE_MAX_PAIR_RUN 31
+
+// Each block is a run of non-NULL bytes (found with memchr, as in cobs_encoded_length) followed by the NULL
+// or NULLs its code stands for. The NULL the payload is taken to end with is never stored, so a NULL at
+// input[length] is "virtual": it ends the frame, and may be the second half of a pair.
+size_t cobs_zpe_encode(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    const uint8_t * end = input + length;
+    uint8_t * out = output;
+
+    for (;;)
+    {
+        size_t avail = (size_t)(end - input);
+        if (avail > ZPE_MAX_RUN) avail = ZPE_MAX_RUN;
+        const uint8_t * null = memchr(input, 0, avail);
+        size_t n = null ? (size_t)(null - input) : avail;
+        uint8_t * code_ptr = out++;
+        memcpy(out, input, n);
+        input += n;
+        out += n;
+
+        if (n == ZPE_MAX_RUN)                               // a full block, no NULL
+        {
+            *code_ptr = 0xDF;
+            if (input == end) break;                        // as for 0xFF in COBS: no block after it
+            continue;
+        }
+        if (input == end)                                   // ended by the virtual NULL
+        {
+            *code_ptr = (uint8_t)(n + 1);
+            break;
+        }
+        // input[0] is a real NULL; the next one, real or virtual, makes a pair
+        if (n <= ZPE_MAX_PAIR_RUN && (input + 1 == end || input[1] == 0))
+        {
+            *code_ptr = (uint8_t)(ZPE_PAIR + n);
+            if (input + 1 == end) break;
+            input += 2;
+        }
+        else
+        {
+            *code_ptr = (uint8_t)(n + 1);
+            input++;
+        }
+    }
+    return out - output;
+}
+
+size_t cobs_zpe_decode(const uint8_t * restrict input, size_t length, uint8_t * restrict output)
+{
+    const uint8_t * end = input + length;
+    uint8_t * out = output;
+
+    while (input < end)
+    {
+        uint8_t code = *input++;
+        if (code == 0) return 0;                            // we can't be having NULL here, error
+        size_t n, nulls;
+        if (code >= ZPE_PAIR)
+        {
+            n = code - ZPE_PAIR;
+            nulls = 2;
+        }
+        else
+        {
+            n = (size_t)code - 1;
+            nulls = code == 0xDF ? 0 : 1;
+        }
+        if (n > (size_t)(end - input)) return 0;            // overrun
+        if (memchr(input, 0, n)) return 0;                  // we can't be having NULL here, either
+        memcpy(out, input, n);
+        input += n;
+        out += n;
+        if (input == end && nulls) nulls--;                 // the NULL the payload was taken to end with
+        for (size_t k = 0; k < nulls; k++) *out++ = 0;
+    }
+    return out - output;
+}
@@ -0,0 +1,35 @@
+/* Copyright 2022, Daniel McBrearty. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted, with or without modification.
+ * The correctness of this software is NOT guaranteed and the user uses it entirely at their own risk.
+ *
+ */
+#ifndef COBS_ZPE_H
+#define COBS_ZPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// COBS/ZPE (zero pair elimination), for payloads with many 0x00 0x00 pairs. Not compatible with plain COBS
+// on the wire; the code bytes are
+//   0x01 - 0xDE   code - 1 data bytes (0 to 221), then a NULL
+//   0xDF          222 data bytes, no NULL
+//   0xE0 - 0xFF   code - 0xE0 data bytes (0 to 31), then two NULLs
+// so a pair of NULLs after a short run costs one code byte instead of two. As with COBS, the payload is
+// taken to end in one more NULL, which the decoder drops again. The output holds no NULL, and the caller
+// appends the terminator as for cobs_encode.
+
+// the most bytes cobs_zpe_encode can return for length bytes of any input: one code byte per 222 bytes of
+// payload, and one more for the last block
+#define COBS_ZPE_ENCODE_MAX_LENGTH(length) ((length) + (length) / 222 + 1)
+
+// ENCODE length bytes from the input, and return the number of bytes in the encoded output (no terminator).
+size_t cobs_zpe_encode(const uint8_t * restrict input, size_t length, uint8_t * restrict output);
+
+// DECODE length bytes of a frame (its terminator already stripped). Returns the number of bytes decoded, or 0 if
+// the input is not valid, for the same reasons as cobs_decode: a NULL in the input, or a code byte pointing past
+// its end. A frame can decode to up to twice its length, so output needs room for 2 * length bytes.
+size_t cobs_zpe_decode(const uint8_t * restrict input, size_t length, uint8_t * restrict output);
+
+#endif